@@ -0,0 +1,38 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#ifndef __CPU_BPRED_H__
+#define __CPU_BPRED_H__
+
+#include <common.h>
+
+/* 分支预测模拟：方向预测器、BTB 和返回地址栈。ISA 在每条控制转移指令执行之后
+ * 用 bpred_branch() 报告它的类别、实际方向和目标，调用和返回的判断与 ftrace 相同。
+ */
+enum { BR_COND, BR_JUMP, BR_CALL, BR_IND, BR_IND_CALL, BR_RET, NR_BR_KIND };
+
+extern bool bpred_active;
+// 最近报告的一条控制转移指令是否预测错误，时序模型用它计算分支的代价
+extern bool bpred_last_miss;
+
+bool bpred_parse(const char *spec);
+void init_bpred();
+void bpred_inst(vaddr_t pc);
+// 条件分支不跳转时 target 是跳转时的目标，静态预测要用到它
+void bpred_branch(vaddr_t pc, int kind, bool taken, vaddr_t target);
+void bpred_report();
+
+#endif
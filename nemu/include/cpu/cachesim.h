@@ -0,0 +1,41 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#ifndef __CPU_CACHESIM_H__
+#define __CPU_CACHESIM_H__
+
+#include <common.h>
+
+/* 缓存模拟器：L1 指令缓存、L1 数据缓存和可选的统一 L2 缓存。
+ * 取指和数据访问都按翻译后的物理地址建模，只模拟对 pmem 的访问。
+ * 只在采样区间内逐条执行并模拟，cachesim_active 表示当前是否在区间内，
+ * 区间外取指和访存不做任何事。
+ */
+enum { CACHE_L1I, CACHE_L1D, CACHE_L2, NR_CACHE };
+
+extern bool cachesim_active;
+
+bool cachesim_parse(const char *spec);
+void init_cachesim();
+bool cachesim_need_step(uint64_t *n);
+bool cachesim_enabled();
+void cachesim_ifetch(vaddr_t pc);
+void cachesim_data(paddr_t addr, int len, bool is_write);
+void cachesim_report();
+// 到目前为止缓存 id 的缺失数，没有配置的缓存为 0，时序模型用它计算缺失的代价
+uint64_t cachesim_misses(int id);
+
+#endif
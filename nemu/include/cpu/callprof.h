@@ -0,0 +1,41 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#ifndef __CPU_CALLPROF_H__
+#define __CPU_CALLPROF_H__
+
+#include <common.h>
+
+/* 调用图 profiler。ftrace 报告的调用和返回维护一个影子调用栈，并建立调用上下文树，
+ * 每条指令的执行次数记在执行它时所在的上下文上（调用指令属于调用者，返回指令属于被调用者）。
+ * callprof_self 指向当前上下文的计数器。
+ */
+extern uint64_t *callprof_self;
+
+void init_callprof(const char *folded_file);
+void callprof_call(vaddr_t target, vaddr_t ret_addr);
+void callprof_ret(vaddr_t target);
+void callprof_report();
+
+static inline bool callprof_enabled() {
+  return callprof_self != NULL;
+}
+
+static inline void callprof_exec() {
+  (*callprof_self) ++;
+}
+
+#endif
@@ -219,11 +219,32 @@ finish:
 }
 
 
+#ifdef CONFIG_INSTPAT_DECODER
+/* tools/gen-decoder 在编译前读取 inst.c 中的 INSTPAT 表，为每一对
+ * INSTPAT_START/INSTPAT_END 生成一个决策树译码器 __instpat_decode_<起始行号>，
+ * 返回第一个匹配的模式在表中的序号。INSTPAT_START 据此 switch 到对应 INSTPAT
+ * 的 case 标号，跳过前面所有模式的匹配，译码代价与模式数量和优化级别都无关。
+ * 每个 INSTPAT 的序号由 __COUNTER__ 得到，INSTPAT_END 检查它和生成时统计的数量一致。
+ */
+#include <generated/instpat-decoder.h>
+#define INSTPAT_CASE() case __COUNTER__ - __instpat_base - 1:
+#define INSTPAT_DISPATCH() enum { __instpat_base = __COUNTER__ }; \
+  switch (concat(__instpat_decode_, __LINE__)(INSTPAT_INST(s))) { default: ;
+#define INSTPAT_DISPATCH_END() \
+  static_assert(__COUNTER__ - __instpat_base - 1 == concat(__instpat_count_, __LINE__), \
+      "the generated decoder is out of date"); }
+#else
+#define INSTPAT_CASE()
+#define INSTPAT_DISPATCH()
+#define INSTPAT_DISPATCH_END()
+#endif
+
 // --- 用于解码的模式匹配包装器 ---
 #define INSTPAT(pattern, ...) do { \
   uint64_t key, mask, shift; \
   pattern_decode(pattern, STRLEN(pattern), &key, &mask, &shift); \
   if ((((uint64_t)INSTPAT_INST(s) >> shift) & mask) == key) { \
+    INSTPAT_CASE() \
     INSTPAT_MATCH(s, ##__VA_ARGS__); \
     goto *(__instpat_end); \
   } \
@@ -248,7 +269,9 @@ goto *(__instpat_end);
 这是一种优化手段，避免继续进行不必要的模式匹配
 */
 
-#define INSTPAT_START(name) { const void * __instpat_end = &&concat(__instpat_end_, name);
-#define INSTPAT_END(name)   concat(__instpat_end_, name): ; }
+// __instpat_end 是静态的，这样从表外直接跳进某个执行体(如译码缓存命中)时它也有定义
+#define INSTPAT_START(name) { static const void * const __instpat_end = &&concat(__instpat_end_, name); \
+  INSTPAT_DISPATCH()
+#define INSTPAT_END(name)   INSTPAT_DISPATCH_END() concat(__instpat_end_, name): ; }
 
 #endif
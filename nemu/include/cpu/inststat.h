@@ -0,0 +1,52 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#ifndef __CPU_INSTSTAT_H__
+#define __CPU_INSTSTAT_H__
+
+#include <common.h>
+
+/* 按类别统计执行的指令，按区域统计数据访存。指令由 ISA 在执行之后分类计数，
+ * 访存在 vaddr 层计入 pmem，在 mmio_read()/mmio_write() 中计入各个 MMIO 区域。
+ */
+enum {
+  INST_ALU, INST_MULDIV,
+  INST_LOAD_B, INST_LOAD_H, INST_LOAD_W,
+  INST_STORE_B, INST_STORE_H, INST_STORE_W,
+  INST_BRANCH_TAKEN, INST_BRANCH_NOT_TAKEN, INST_JUMP,
+  INST_CSR, INST_ECALL, INST_SYSTEM, INST_OTHER,
+  NR_INST_CLASS
+};
+
+typedef struct {
+  uint64_t nr_read, nr_write;
+  uint64_t read_bytes, write_bytes;
+} MemStat;
+
+extern uint64_t inst_stat[NR_INST_CLASS];
+extern MemStat pmem_stat;
+
+void init_inststat(const char *json_file);
+void inst_statistic();
+// 依次返回第 i 个 MMIO 区域的统计，i 超出范围时返回 NULL
+MemStat* mmio_stat(int i, const char **name);
+
+static inline void mem_stat_add(MemStat *m, int len, bool is_write) {
+  if (is_write) { m->nr_write ++; m->write_bytes += len; }
+  else { m->nr_read ++; m->read_bytes += len; }
+}
+
+#endif
@@ -3,18 +3,39 @@
 
 #include <common.h>
 
-#define IRINGBUF_SIZE 16  // 环形缓冲区大小，可根据需求调整
+// 环形缓冲区大小，必须是 2 的幂
+#define IRINGBUF_SIZE MUXDEF(CONFIG_ITRACE, CONFIG_IRINGBUF_SIZE, 16)
 
+// 指令的最大字节数，x86 的指令是变长的
+#define IRINGBUF_INST_MAX MUXDEF(CONFIG_ISA_x86, 16, 4)
+
+// 只保存地址和指令，反汇编推迟到 iringbuf_display() 时才做
 typedef struct {
   vaddr_t pc;           // 指令地址
-  uint32_t inst;        // 指令内容
-  char asm_buf[128];    // 反汇编后的指令字符串
+  uint8_t len;          // 指令长度，0 表示还没有执行完
+  uint8_t inst[IRINGBUF_INST_MAX];  // 指令内容，按内存中的顺序存放
 } iringbuf_entry_t;
 
-// 在环形缓冲区中记录一条指令
-void iringbuf_record(vaddr_t pc, uint32_t inst, const char *asm_buf);
+extern iringbuf_entry_t iringbuf[IRINGBUF_SIZE];
+extern uint64_t iringbuf_count;  // 记录过的指令总数
+
+/* 在环形缓冲区中记录一条指令。在执行之前调用，这样执行过程中出错时
+ * 也能看到出错的指令；指令内容在执行之后再填入返回的表项。
+ */
+static inline iringbuf_entry_t* iringbuf_record(vaddr_t pc) {
+  iringbuf_entry_t *e = &iringbuf[iringbuf_count ++ & (IRINGBUF_SIZE - 1)];
+  e->pc = pc;
+  e->len = 0;
+  return e;
+}
+
+// 填入长为 len 的指令，inst 处要有 IRINGBUF_INST_MAX 个可读的字节，这样复制的长度是常数
+static inline void iringbuf_fill(iringbuf_entry_t *e, const void *inst, int len) {
+  memcpy(e->inst, inst, IRINGBUF_INST_MAX);
+  e->len = len;
+}
 
 // 打印环形缓冲区内容
 void iringbuf_display();
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,41 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#ifndef __CPU_PCPROF_H__
+#define __CPU_PCPROF_H__
+
+#include <common.h>
+
+/* 按 pc 统计每条指令的执行次数。计数器是以 (pc - CONFIG_MBASE) >> 2 为下标的
+ * 稠密数组，不在这个范围内的 pc 只计入总数。
+ */
+extern uint64_t *pcprof_count;
+extern uint64_t pcprof_other;
+
+void init_pcprof(const char *dump_file);
+void pcprof_report();
+
+static inline bool pcprof_enabled() {
+  return pcprof_count != NULL;
+}
+
+static inline void pcprof_exec(vaddr_t pc) {
+  word_t idx = (pc - CONFIG_MBASE) >> 2;
+  if (likely(idx < CONFIG_MSIZE / 4)) pcprof_count[idx] ++;
+  else pcprof_other ++;
+}
+
+#endif
@@ -0,0 +1,32 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#ifndef __CPU_SIMPOINT_H__
+#define __CPU_SIMPOINT_H__
+
+#include <common.h>
+
+struct Decode;
+
+/* SimPoint 基本块向量（BBV）采样：每 interval 条指令输出一行 .bb 格式的记录，
+ * 记录这段区间内每个基本块执行的指令数。开启后所有指令都走插桩执行循环。
+ */
+void init_simpoint(const char *file, uint64_t interval);
+bool simpoint_enabled();
+void simpoint_exec(struct Decode *s);
+void simpoint_finish();
+
+#endif
@@ -0,0 +1,54 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#ifndef __CPU_TB_H__
+#define __CPU_TB_H__
+
+#include <common.h>
+
+struct Decode;
+
+// 一个基本块最多包含的指令数
+#define TB_MAX_INST 32
+
+// 线程化执行的基本块：op 中是 ISA 相关的预译码项，按顺序分派执行
+typedef struct TBlock {
+  vaddr_t pc;                 // 块的起始地址，nr_inst 为 0 表示该块无效
+  int nr_inst;
+  struct TBlock *next[2];     // 块链接：最近跳转到的后继块，省去查表
+#ifdef CONFIG_JIT
+  uint32_t hot;               // 执行次数，达到阈值时编译成本机代码
+  void *host_code;            // 编译出的本机代码，NULL 表示还没有编译
+#endif
+  const void *op[TB_MAX_INST];
+} TBlock;
+
+// 执行从 cpu.pc 开始的基本块，最多执行 n 条指令，返回实际执行的指令数
+uint64_t tb_exec(uint64_t n);
+void tb_flush();
+
+#ifdef CONFIG_JIT
+// 执行基本块，足够热时改为执行编译出的本机代码，返回值同 isa_tb_exec
+int jit_tb_exec(TBlock *tb, struct Decode *s);
+void jit_flush();
+// 由 pmem_code_write 调用：被改写的指令如果已经编译过，作废全部本机代码
+void jit_code_write(paddr_t addr, int len);
+#endif
+
+// ISA 接口
+int isa_tb_build(TBlock *tb);
+int isa_tb_exec(TBlock *tb, struct Decode *s);
+
+#endif
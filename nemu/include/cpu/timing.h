@@ -0,0 +1,36 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#ifndef __CPU_TIMING_H__
+#define __CPU_TIMING_H__
+
+#include <common.h>
+
+/* 五级顺序流水线的近似时序模型。ISA 在每条指令执行之后用 timing_inst() 报告
+ * 它的类别和用到的寄存器(0 表示不用)，模型按延迟表给它分配周期：每条指令 1 个
+ * 基本周期，加上 load-use 冒险、乘除法、分支、异常与 CSR 以及缓存缺失造成的停顿。
+ * 分支预测和缓存缺失来自同时开启的分支预测器和缓存模拟器。
+ */
+enum { T_ALU, T_MUL, T_DIV, T_LOAD, T_STORE, T_BRANCH, T_JUMP, T_JUMP_IND, T_SYSTEM };
+
+extern bool timing_active;
+
+bool timing_parse(const char *spec);
+void init_timing();
+void timing_inst(vaddr_t pc, int cls, int rd, int rs1, int rs2, bool taken);
+void timing_report();
+
+#endif
@@ -28,6 +28,7 @@ typedef struct {
   paddr_t high;
   void *space;
   io_callback_t callback;
+  bool direct; // 访问没有副作用，软件 TLB 可以直接读写 space
 } IOMap;
 
 static inline bool map_inside(IOMap *map, paddr_t addr) {
@@ -49,6 +50,8 @@ void add_pio_map(const char *name, ioaddr_t addr,
         void *space, uint32_t len, io_callback_t callback);
 void add_mmio_map(const char *name, paddr_t addr,
         void *space, uint32_t len, io_callback_t callback);
+// 映射一段像内存一样的区域(如显存)，设备不关心每一次访问，可以被直接读写
+void add_mmio_map_direct(const char *name, paddr_t addr, void *space, uint32_t len);
 
 word_t map_read(paddr_t addr, int len, IOMap *map);
 void map_write(paddr_t addr, int len, word_t data, IOMap *map);
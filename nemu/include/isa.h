@@ -32,10 +32,18 @@ void init_isa();
 extern CPU_state cpu;
 void isa_reg_display();
 word_t isa_reg_str2val(const char *name, bool *success);
+const word_t* isa_reg_str2ptr(const char *name);
 
 // exec
 struct Decode;
 int isa_exec_once(struct Decode *s);
+// 刚执行完的指令是否结束了一个基本块（分支、跳转等）
+bool isa_bb_end(struct Decode *s);
+#ifdef CONFIG_DECODE_CACHE
+void isa_decode_cache_invalidate(paddr_t addr, int len);
+void isa_decode_cache_flush();
+void isa_decode_cache_flush_page(vaddr_t vpage, uint32_t ctx);
+#endif
 
 // memory
 enum { MMU_DIRECT, MMU_TRANSLATE, MMU_FAIL };
@@ -45,6 +53,12 @@ enum { MEM_RET_OK, MEM_RET_FAIL, MEM_RET_CROSS_PAGE };
 int isa_mmu_check(vaddr_t vaddr, int len, int type);
 #endif
 paddr_t isa_mmu_translate(vaddr_t vaddr, int len, int type);
+// 与 isa_mmu_translate 相同，但不改变 TLB 及其统计，也不记下异常
+paddr_t isa_mmu_peek(vaddr_t vaddr, int type);
+#ifdef CONFIG_RV_SV32
+void isa_mmu_statistic();
+void isa_mmu_flush();
+#endif
 
 // interrupt/exception
 vaddr_t isa_raise_intr(word_t NO, vaddr_t epc);
@@ -17,6 +17,7 @@
 #define __MEMORY_PADDR_H__
 
 #include <common.h>
+#include <memory/vaddr.h>
 
 #define PMEM_LEFT  ((paddr_t)CONFIG_MBASE)
 #define PMEM_RIGHT ((paddr_t)CONFIG_MBASE + CONFIG_MSIZE - 1)
@@ -34,4 +35,70 @@ static inline bool in_pmem(paddr_t addr) {
 word_t paddr_read(paddr_t addr, int len);
 void paddr_write(paddr_t addr, int len, word_t data);
 
+#ifdef CONFIG_DECODE_CACHE
+/* Pages of pmem holding instructions which are cached by the decode cache
+ * or the JIT. Writing to such a page must invalidate the cached copies.
+ * Each cache sets its own bit and clears it when it no longer holds
+ * anything from the page.
+ */
+#define PMEM_CODE_DECODE 1
+#define PMEM_CODE_JIT    2
+extern uint8_t pmem_code_page[];
+
+static inline void pmem_mark_code(paddr_t addr, int owner) {
+  uint8_t *p = &pmem_code_page[(addr - CONFIG_MBASE) >> PAGE_SHIFT];
+  if (unlikely(!(*p & owner))) {
+    // 软件 TLB 中的写表项会绕过 paddr_write() 中的检查，要作废
+    IFDEF(CONFIG_SOFT_TLB, if (*p == 0) soft_tlb_unmap_write(addr & ~(paddr_t)PAGE_MASK));
+    *p |= owner;
+  }
+}
+
+static inline void pmem_unmark_code(paddr_t addr, int owner) {
+  pmem_code_page[(addr - CONFIG_MBASE) >> PAGE_SHIFT] &= ~owner;
+}
+
+// 写 [addr, addr + len) 是否会改到代码页，跨页的写两页都要检查
+static inline bool pmem_is_code(paddr_t addr, int len) {
+  paddr_t last = addr + len - 1;
+  if (unlikely(!in_pmem(last))) last = PMEM_RIGHT;
+  return pmem_code_page[(addr - CONFIG_MBASE) >> PAGE_SHIFT] |
+         pmem_code_page[(last - CONFIG_MBASE) >> PAGE_SHIFT];
+}
+
+// 清除所有页上 owner 的标记，在对应的缓存整体作废时调用
+void pmem_unmark_code_all(int owner);
+void pmem_code_write(paddr_t addr, int len);
+#endif
+
+#ifdef CONFIG_WATCHPOINT
+/* 设置了数据监视点的 pmem 页，每页一个字节。没有监视点的页只多一次查表；
+ * 有监视点的页不会进入软件 TLB，访问都经过下面的检查。
+ */
+#define PMEM_WATCH_WRITE 1
+#define PMEM_WATCH_READ  2
+extern uint8_t pmem_watch_page[];
+
+static inline int pmem_watch_flags(paddr_t addr, int len) {
+  paddr_t last = addr + len - 1;
+  if (unlikely(!in_pmem(last))) last = PMEM_RIGHT;
+  return pmem_watch_page[(addr - CONFIG_MBASE) >> PAGE_SHIFT] |
+         pmem_watch_page[(last - CONFIG_MBASE) >> PAGE_SHIFT];
+}
+
+void pmem_watch_clear();
+void pmem_watch_set(paddr_t addr, word_t len, int flags);
+// 是否有页设置了数据监视点
+bool pmem_watch_any();
+// 在 monitor/sdb/watchpoint.c 中实现，访问命中数据监视点时返回 true
+bool check_data_watchpoints(paddr_t addr, int len, bool is_write, word_t old_val, word_t new_val);
+
+// 数据读由 vaddr 层检查，paddr_read() 还用于取指和调试器读内存
+static inline void pmem_watch_read(paddr_t addr, int len, word_t val) {
+  if (in_pmem(addr) && unlikely(pmem_watch_flags(addr, len) & PMEM_WATCH_READ)) {
+    if (check_data_watchpoints(addr, len, false, val, val)) nemu_state.state = NEMU_STOP;
+  }
+}
+#endif
+
 #endif
@@ -18,12 +18,91 @@
 
 #include <common.h>
 
-word_t vaddr_ifetch(vaddr_t addr, int len);
-word_t vaddr_read(vaddr_t addr, int len);
-void vaddr_write(vaddr_t addr, int len, word_t data);
-
 #define PAGE_SHIFT        12
 #define PAGE_SIZE         (1ul << PAGE_SHIFT)
 #define PAGE_MASK         (PAGE_SIZE - 1)
 
+/* 当前地址空间的编号，左移 32 位后与虚拟地址合成按虚拟地址缓存的内容(软件 TLB、
+ * 译码缓存)的标签。不做地址翻译时为 0；开启地址翻译时由 ISA 按 satp 分配，
+ * 页表被改动后换用新的编号，因此切换地址空间和 sfence.vma 都不必清空这些缓存。
+ * 只有虚拟地址为 32 位的 ISA 会把它设为非 0。
+ */
+extern uint64_t vm_ctx;
+
+// 不改变 TLB 及其统计地查询 addr 的物理地址，翻译失败时返回 false
+bool vaddr_peek(vaddr_t addr, int type, paddr_t *paddr);
+
+#ifdef CONFIG_SOFT_TLB
+#include <isa.h>
+#include <memory/host.h>
+#ifdef CONFIG_INST_STAT
+#include <cpu/inststat.h>
+#endif
+#ifdef CONFIG_CACHE_SIM
+#include <cpu/cachesim.h>
+#endif
+
+/* 软件 TLB：按虚拟页直接映射，取指、读、写各一张表，记录虚拟页对应的宿主地址。
+ * 命中时只需一次比较和一次宿主访存。tag 是 vm_ctx 与虚拟页的基址，无效项为全 1；
+ * MMIO 页的 tag 额外置上 SOFT_TLB_MMIO，快速路径不会命中，
+ * 慢速路径用它省去地址翻译。
+ */
+// 没有对齐的访问会在 tag 中留下低 3 位，标志位不能与它们重叠
+#define SOFT_TLB_MMIO (PAGE_SIZE >> 1)
+
+typedef struct {
+  uint64_t tag;
+  uintptr_t addend; // 内存页：宿主地址 = vaddr + addend；MMIO 页：paddr = vaddr + addend
+} SoftTLBEntry;
+
+extern SoftTLBEntry soft_tlb[3][CONFIG_SOFT_TLB_SIZE];
+
+void soft_tlb_flush();
+void soft_tlb_flush_page(vaddr_t vpage);
+void soft_tlb_unmap_write(paddr_t ppage);
+word_t soft_tlb_read(vaddr_t addr, int len, int type);
+void soft_tlb_write(vaddr_t addr, int len, word_t data);
+
+static inline SoftTLBEntry* soft_tlb_entry(int type, vaddr_t addr) {
+  return &soft_tlb[type][(addr >> PAGE_SHIFT) % CONFIG_SOFT_TLB_SIZE];
+}
+
+// 没有对齐的访问保留了低位，因此也不会命中
+static inline uint64_t soft_tlb_tag(vaddr_t addr, int len) {
+  return vm_ctx | (addr & (~(vaddr_t)PAGE_MASK | (len - 1)));
+}
+
+static inline word_t vaddr_ifetch(vaddr_t addr, int len) {
+  SoftTLBEntry *e = soft_tlb_entry(MEM_TYPE_IFETCH, addr);
+  if (likely(e->tag == soft_tlb_tag(addr, len))) return host_read((void *)(e->addend + addr), len);
+  return soft_tlb_read(addr, len, MEM_TYPE_IFETCH);
+}
+
+// 开启访存统计时 MMIO 页不会直接映射，命中的都是 pmem
+static inline word_t vaddr_read(vaddr_t addr, int len) {
+  // 模拟缓存要用翻译后的物理地址，交给慢速路径
+  IFDEF(CONFIG_CACHE_SIM, if (unlikely(cachesim_active)) return soft_tlb_read(addr, len, MEM_TYPE_READ));
+  SoftTLBEntry *e = soft_tlb_entry(MEM_TYPE_READ, addr);
+  if (likely(e->tag == soft_tlb_tag(addr, len))) {
+    IFDEF(CONFIG_INST_STAT, mem_stat_add(&pmem_stat, len, false));
+    return host_read((void *)(e->addend + addr), len);
+  }
+  return soft_tlb_read(addr, len, MEM_TYPE_READ);
+}
+
+static inline void vaddr_write(vaddr_t addr, int len, word_t data) {
+  IFDEF(CONFIG_CACHE_SIM, if (unlikely(cachesim_active)) { soft_tlb_write(addr, len, data); return; });
+  SoftTLBEntry *e = soft_tlb_entry(MEM_TYPE_WRITE, addr);
+  if (likely(e->tag == soft_tlb_tag(addr, len))) {
+    IFDEF(CONFIG_INST_STAT, mem_stat_add(&pmem_stat, len, true));
+    host_write((void *)(e->addend + addr), len, data);
+  }
+  else soft_tlb_write(addr, len, data);
+}
+#else
+word_t vaddr_ifetch(vaddr_t addr, int len);
+word_t vaddr_read(vaddr_t addr, int len);
+void vaddr_write(vaddr_t addr, int len, word_t data);
+#endif
+
 #endif
@@ -0,0 +1,54 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#ifndef __MONITOR_BREAKPOINT_H__
+#define __MONITOR_BREAKPOINT_H__
+
+#include <common.h>
+
+#ifdef CONFIG_BREAKPOINT
+/* 执行引擎用到的断点查询，断点的管理在 monitor/sdb/breakpoint.c 中。
+ * 基本块不会跨过有断点的 pc，快速执行循环只需在块的边界上检查。
+ */
+
+// 断点表的粒度，x86 的指令可以从任意字节开始
+#define BP_SHIFT MUXDEF(CONFIG_ISA_x86, 0, 1)
+extern uint8_t *bp_map;
+extern int nr_bp;
+extern int nr_bp_far;
+
+bool bp_hit(vaddr_t pc);
+
+static inline bool has_breakpoints() {
+  return nr_bp > 0;
+}
+
+// pc 上是否可能有断点，pmem 之外的断点不在表中，有就按可能处理；要先确认 has_breakpoints()
+static inline bool bp_at(vaddr_t pc) {
+  if (likely(pc - CONFIG_MBASE < CONFIG_MSIZE)) {
+    word_t off = (pc - CONFIG_MBASE) >> BP_SHIFT;
+    return bp_map[off >> 3] & (1 << (off & 7));
+  }
+  return nr_bp_far > 0;
+}
+
+// 执行循环中对每个 pc 的检查，没有断点的 pc 只需一次位测试
+static inline bool check_breakpoints(vaddr_t pc) {
+  if (likely(!bp_at(pc))) return false;
+  return bp_hit(pc);
+}
+#endif
+
+#endif
@@ -7,21 +7,35 @@ typedef struct {
   char *name;       // 函数名
   uint32_t addr;    // 函数起始地址
   uint32_t size;    // 函数大小
+  int elf;          // 来自第几个 ELF 文件，地址重叠时后加载的优先
 } FuncInfo;
 
 typedef struct {
   bool enabled;           // ftrace是否启用
   int func_count;         // 函数数量
   int call_depth;         // 当前调用深度
-  FuncInfo *functions;    // 函数信息数组
+  int elf_count;          // 已加载的 ELF 文件数量
+  FuncInfo *functions;    // 函数信息数组，按起始地址排序
 } FtraceState;
 
+// 可以多次调用，依次加载多个 ELF 文件（例如内核和 Navy 应用）的符号
 void init_ftrace(const char *elf_file);
 void ftrace_call(uint32_t pc, uint32_t target);
 void ftrace_ret(uint32_t pc, uint32_t target);
 FuncInfo* find_function(uint32_t addr);
+FuncInfo* find_function_by_name(const char *name);
 void cleanup_ftrace();
 
+/* 按函数汇总的剖析报告共用的部分。函数的编号是它在 functions[] 中的下标，
+ * 没有符号的地址都记为编号 func_nr()，所以统计数组要有 func_nr() + 1 项。
+ * 编号随加载的符号而变，要在加载完符号之后再分配统计数组。
+ */
+int func_nr();
+int func_index(const FuncInfo *f);
+const char* func_name(int id);
+// 把所有编号按 key 从大到小排序，前 n 个放在 order 中，返回放入的个数
+int func_top(uint64_t (*key)(int id), int *order, int n);
+
 extern FtraceState ftrace_state;
 
 #endif
\ No newline at end of file
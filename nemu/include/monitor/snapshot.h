@@ -0,0 +1,41 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#ifndef __MONITOR_SNAPSHOT_H__
+#define __MONITOR_SNAPSHOT_H__
+
+#include <common.h>
+
+/* 保存和恢复整台机器的状态。除 pmem 以外的状态用同一个函数双向处理：
+ * 各模块的 xxx_snapshot() 对每块数据调用 snapshot_data()，
+ * 保存时写入文件，恢复时从文件读回。
+ */
+typedef struct {
+  FILE *fp;
+  bool is_save;
+  bool ok;
+} Snapshot;
+
+void snapshot_data(Snapshot *ss, void *buf, size_t size);
+
+bool snapshot_save(const char *file);
+bool snapshot_load(const char *file);
+
+// 各模块的状态
+void timer_snapshot(Snapshot *ss);
+void map_snapshot(Snapshot *ss);
+void keyboard_snapshot(Snapshot *ss);
+
+#endif
@@ -0,0 +1,67 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#ifndef __TRACE_FORMAT_H__
+#define __TRACE_FORMAT_H__
+
+#include <stdint.h>
+
+/* 二进制追踪文件的格式，NEMU 写入，tools/trace-dump 读出。
+ * 文件以 TraceHeader 开头，之后是一串记录。每个记录以一个标签字节开始，
+ * 低 4 位是记录类型，指令记录的高 4 位是指令长度。
+ * 地址差用 zigzag 编码后再按 LEB128 变长编码，顺序执行的指令只占 1 + 指令长度 个字节。
+ */
+#define TRACE_MAGIC "NEMUTRC"
+#define TRACE_VERSION 1
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t word_size;   // 客户机地址的字节数
+  char isa[16];
+} TraceHeader;
+
+enum {
+  TRACE_INST_SEQ = 1,   // 紧接在上一条指令之后的指令：指令字节
+  TRACE_INST,           // varint(pc - 上一条指令的 pc)，指令字节
+  TRACE_CALL,           // varint(target - pc)，varint(调用深度)，pc 是上一条指令的地址
+  TRACE_RET,            // 同 TRACE_CALL
+};
+
+#define TRACE_TAG(type, ilen) ((uint8_t)((type) | ((ilen) << 4)))
+#define TRACE_TAG_TYPE(tag)   ((tag) & 0xf)
+#define TRACE_TAG_ILEN(tag)   ((tag) >> 4)
+
+static inline uint64_t trace_zigzag(int64_t v) {
+  return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t trace_unzigzag(uint64_t v) {
+  return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+// 写入 LEB128 编码的 v，返回写入的字节数（至多 10 个字节）
+static inline int trace_put_varint(uint8_t *p, uint64_t v) {
+  int n = 0;
+  while (v >= 0x80) {
+    p[n ++] = (v & 0x7f) | 0x80;
+    v >>= 7;
+  }
+  p[n ++] = v;
+  return n;
+}
+
+#endif
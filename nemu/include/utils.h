@@ -61,17 +61,60 @@ uint64_t get_time();
     extern FILE* log_fp; \
     extern bool log_enable(); \
     if (log_enable() && log_fp != NULL) { \
-      fprintf(log_fp, __VA_ARGS__); \
-      fflush(log_fp); \
+      MUXDEF(CONFIG_LOG_ASYNC, log_async_write(__VA_ARGS__), \
+        (fprintf(log_fp, __VA_ARGS__), fflush(log_fp))); \
     } \
   } while (0) \
 )
 
+void log_flush();
+#ifdef CONFIG_LOG_ASYNC
+void log_async_write(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+#endif
+
 #define _Log(...) \
   do { \
     printf(__VA_ARGS__); \
     log_write(__VA_ARGS__); \
   } while (0)
 
+// ----------- trace control -----------
+
+/* 可以在运行时打开和关闭的追踪。TRACE_LOG 表示把 Log() 的输出也写入日志文件，
+ * 默认的追踪窗口 [CONFIG_TRACE_START, CONFIG_TRACE_END] 带有它。
+ */
+enum { TRACE_ITRACE = 1, TRACE_FTRACE = 2, TRACE_MTRACE = 4, TRACE_LOG = 8 };
+
+#ifdef CONFIG_TRACE
+// 当前生效的追踪种类，执行循环和访存路径只检查它
+extern int trace_active;
+// 当前指令开始执行时生效的追踪种类
+extern int trace_inst_active;
+
+void init_trace();
+bool trace_command(char *args);
+void trace_clear();
+void trace_set(int kind, bool on);
+int trace_parse_kind(const char *str);
+bool trace_need_step(uint64_t *n);
+void trace_step(vaddr_t pc);
+void trace_func_call(vaddr_t target, int depth);
+void trace_func_ret(int depth);
+#endif
+
+// 没有 CONFIG_TRACE 时 ftrace 仍然在加载了符号后输出
+#define trace_enabled(kind) MUXDEF(CONFIG_TRACE, ((trace_active & (kind)) != 0), ((kind) == TRACE_FTRACE))
+
+// ----------- binary trace -----------
+
+#ifdef CONFIG_TRACE_BINARY
+void init_tracebin(const char *file);
+bool tracebin_enabled();
+void tracebin_flush();
+void tracebin_inst(vaddr_t pc, const uint8_t *inst, int ilen);
+void tracebin_call(vaddr_t pc, vaddr_t target);
+void tracebin_ret(vaddr_t pc, vaddr_t target);
+#endif
+
 
 #endif
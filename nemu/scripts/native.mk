@@ -17,6 +17,7 @@
 include $(NEMU_HOME)/scripts/build.mk
 
 include $(NEMU_HOME)/tools/difftest.mk
+include $(NEMU_HOME)/tools/gen-decoder.mk
 
 compile_git:
 	$(call git_commit, "compile NEMU")
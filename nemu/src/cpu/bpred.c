@@ -0,0 +1,315 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <isa.h>
+#include <cpu/bpred.h>
+#include <monitor/ftrace.h>
+
+enum { PRED_STATIC, PRED_BIMODAL, PRED_GSHARE, PRED_TAGE };
+static const char *pred_name[] = { "static", "bimodal", "gshare", "tage" };
+static const char *kind_name[NR_BR_KIND] = {
+  [BR_COND] = "conditional", [BR_JUMP] = "jump", [BR_CALL] = "call",
+  [BR_IND] = "indirect", [BR_IND_CALL] = "indirect call", [BR_RET] = "return",
+};
+
+bool bpred_active = false;
+bool bpred_last_miss = false;
+static bool configured = false;
+static int pred = PRED_BIMODAL;
+static int pred_bits = 12;
+static int btb_size = 512;
+static int ras_depth = 16;
+
+static uint8_t *pht = NULL;    // 2 位饱和计数器，bimodal/gshare 的模式表和 TAGE 的基础预测器
+static uint64_t ghist = 0;     // 全局历史，最近的一次条件分支在最低位
+
+typedef struct {
+  vaddr_t pc, target;
+  bool valid;
+} BTBEntry;
+static BTBEntry *btb = NULL;
+
+static vaddr_t *ras = NULL;
+static int ras_top = 0, ras_count = 0;
+
+// TAGE-lite：一个基础预测器加上 4 张按几何级数增长的历史长度索引的带标签表
+#define TAGE_NR_TABLE 4
+#define TAGE_TAG_BITS 9
+#define TAGE_U_RESET_PERIOD (256 * 1024)
+static const int tage_hist_len[TAGE_NR_TABLE] = { 5, 11, 23, 47 };
+
+typedef struct {
+  uint16_t tag;
+  int8_t ctr;   // -4 到 3，非负表示跳转
+  uint8_t u;    // 0 到 3
+} TageEntry;
+static TageEntry *tage[TAGE_NR_TABLE] = {};
+static int tage_bits = 0;
+static uint64_t tage_nr_update = 0;
+
+static uint64_t nr_inst = 0;
+static uint64_t nr_branch[NR_BR_KIND] = {}, nr_dir_miss[NR_BR_KIND] = {}, nr_target_miss[NR_BR_KIND] = {};
+
+// 每个函数执行的指令数和预测错误数，没有符号的地址记在最后一项
+typedef struct {
+  uint64_t inst, miss;
+} FuncStat;
+static FuncStat *func_stat = NULL;
+static int nr_func = 0;
+
+static bool is_pow2(uint64_t x) { return x != 0 && (x & (x - 1)) == 0; }
+
+/* 解析一项 --bpred 选项：
+ *   static|bimodal|gshare|tage[:BITS]  方向预测器，BITS 是模式表下标的位数
+ *   btb:ENTRIES                        BTB 的项数
+ *   ras:DEPTH                          返回地址栈的深度，0 表示不用
+ */
+bool bpred_parse(const char *spec) {
+  char buf[64];
+  snprintf(buf, sizeof(buf), "%s", spec);
+  char *name = strtok(buf, ":");
+  char *arg = strtok(NULL, ":");
+  int v = (arg != NULL ? atoi(arg) : -1);
+  configured = true;
+  if (name != NULL && strcmp(name, "btb") == 0 && is_pow2(v)) { btb_size = v; return true; }
+  if (name != NULL && strcmp(name, "ras") == 0 && v >= 0) { ras_depth = v; return true; }
+  for (int i = 0; name != NULL && i < ARRLEN(pred_name); i ++) {
+    if (strcmp(name, pred_name[i]) != 0) continue;
+    if (arg != NULL && (v < 4 || v > 24)) break;
+    pred = i;
+    if (arg != NULL) pred_bits = v;
+    return true;
+  }
+  printf("Invalid branch predictor '%s', the format is static|bimodal|gshare|tage[:BITS], "
+      "btb:ENTRIES or ras:DEPTH, where 4 <= BITS <= 24 and ENTRIES is a power of 2\n", spec);
+  return false;
+}
+
+void init_bpred() {
+  if (!configured) return;
+  pht = malloc(1 << pred_bits);
+  btb = calloc(btb_size, sizeof(BTBEntry));
+  ras = calloc(ras_depth + 1, sizeof(vaddr_t));
+  assert(pht && btb && ras);
+  // 初始为弱跳转
+  memset(pht, 2, 1 << pred_bits);
+  if (pred == PRED_TAGE) {
+    tage_bits = (pred_bits > 6 ? pred_bits - 2 : 4);
+    for (int i = 0; i < TAGE_NR_TABLE; i ++) {
+      tage[i] = calloc(1 << tage_bits, sizeof(TageEntry));
+      assert(tage[i]);
+    }
+  }
+  nr_func = func_nr();
+  func_stat = calloc(nr_func + 1, sizeof(FuncStat));
+  assert(func_stat);
+  bpred_active = true;
+  atexit(bpred_report);
+  Log("Branch prediction: %s with %d-bit tables, %d-entry BTB, %d-entry RAS",
+      pred_name[pred], pred_bits, btb_size, ras_depth);
+}
+
+static FuncStat* func_of(vaddr_t pc) {
+  return &func_stat[func_index(find_function(pc))];
+}
+
+void bpred_inst(vaddr_t pc) {
+  nr_inst ++;
+  func_of(pc)->inst ++;
+}
+
+static inline void ctr2_update(uint8_t *c, bool taken) {
+  if (taken) { if (*c < 3) (*c) ++; }
+  else { if (*c > 0) (*c) --; }
+}
+
+static inline uint32_t pht_index(vaddr_t pc) {
+  uint32_t idx = pc >> 2;
+  if (pred == PRED_GSHARE) idx ^= (uint32_t)ghist;
+  return idx & ((1u << pred_bits) - 1);
+}
+
+// 把最近 len 位历史折叠成 bits 位
+static inline uint32_t fold(uint64_t h, int len, int bits) {
+  if (len < 64) h &= (1ull << len) - 1;
+  uint32_t r = 0;
+  for (; h != 0; h >>= bits) r ^= h & ((1u << bits) - 1);
+  return r;
+}
+
+static inline uint32_t tage_index(int t, vaddr_t pc) {
+  return ((pc >> 2) ^ (pc >> (2 + tage_bits)) ^ fold(ghist, tage_hist_len[t], tage_bits)) & ((1u << tage_bits) - 1);
+}
+
+static inline uint16_t tage_tag(int t, vaddr_t pc) {
+  uint64_t h = ghist;
+  return ((pc >> 2) ^ fold(h, tage_hist_len[t], TAGE_TAG_BITS) ^ (fold(h, tage_hist_len[t], TAGE_TAG_BITS - 1) << 1))
+    & ((1u << TAGE_TAG_BITS) - 1);
+}
+
+static bool tage_predict_update(vaddr_t pc, bool taken) {
+  uint32_t idx[TAGE_NR_TABLE];
+  uint16_t tag[TAGE_NR_TABLE];
+  int provider = -1, alt = -1;
+  for (int t = TAGE_NR_TABLE - 1; t >= 0; t --) {
+    idx[t] = tage_index(t, pc);
+    tag[t] = tage_tag(t, pc);
+    if (tage[t][idx[t]].tag == tag[t]) {
+      if (provider < 0) provider = t;
+      else if (alt < 0) alt = t;
+    }
+  }
+  uint8_t *base = &pht[pht_index(pc)];
+  bool base_pred = (*base >= 2);
+  bool alt_pred = (alt >= 0 ? tage[alt][idx[alt]].ctr >= 0 : base_pred);
+  bool pred_taken = (provider >= 0 ? tage[provider][idx[provider]].ctr >= 0 : base_pred);
+
+  if (provider >= 0) {
+    TageEntry *e = &tage[provider][idx[provider]];
+    if (taken) { if (e->ctr < 3) e->ctr ++; }
+    else { if (e->ctr > -4) e->ctr --; }
+    if (pred_taken != alt_pred) {
+      if (pred_taken == taken) { if (e->u < 3) e->u ++; }
+      else { if (e->u > 0) e->u --; }
+    }
+  } else {
+    ctr2_update(base, taken);
+  }
+
+  // 预测错误时在更长历史的表中分配一项，没有空闲项时让它们的 u 老化
+  if (pred_taken != taken && provider < TAGE_NR_TABLE - 1) {
+    int t;
+    for (t = provider + 1; t < TAGE_NR_TABLE && tage[t][idx[t]].u != 0; t ++) ;
+    if (t < TAGE_NR_TABLE) {
+      tage[t][idx[t]] = (TageEntry) { .tag = tag[t], .ctr = (taken ? 0 : -1), .u = 0 };
+    } else {
+      for (t = provider + 1; t < TAGE_NR_TABLE; t ++) tage[t][idx[t]].u --;
+    }
+  }
+  if (++ tage_nr_update % TAGE_U_RESET_PERIOD == 0) {
+    for (int t = 0; t < TAGE_NR_TABLE; t ++) {
+      for (int i = 0; i < (1 << tage_bits); i ++) tage[t][i].u >>= 1;
+    }
+  }
+  return pred_taken;
+}
+
+// 预测条件分支的方向并用实际方向更新预测器
+static bool predict_direction(vaddr_t pc, bool taken, vaddr_t target) {
+  bool pred_taken;
+  switch (pred) {
+    case PRED_STATIC: pred_taken = (target < pc); break;  // 向后跳转，向前不跳转
+    case PRED_TAGE: pred_taken = tage_predict_update(pc, taken); break;
+    default: {
+      uint8_t *c = &pht[pht_index(pc)];
+      pred_taken = (*c >= 2);
+      ctr2_update(c, taken);
+      break;
+    }
+  }
+  ghist = (ghist << 1) | taken;
+  return pred_taken;
+}
+
+static inline BTBEntry* btb_entry(vaddr_t pc) {
+  return &btb[(pc >> 2) & (btb_size - 1)];
+}
+
+void bpred_branch(vaddr_t pc, int kind, bool taken, vaddr_t target) {
+  nr_branch[kind] ++;
+  bool miss = false;
+  if (kind == BR_COND) {
+    bool pred_taken = predict_direction(pc, taken, target);
+    if (pred_taken != taken) {
+      nr_dir_miss[kind] ++;
+      miss = true;
+    }
+  }
+
+  // 取指时要预测出跳转的目标：返回用返回地址栈，其余用 BTB
+  if (taken && !miss) {
+    vaddr_t pred_target = 0;
+    bool hit = false;
+    if (kind == BR_RET && ras_count > 0) {
+      pred_target = ras[ras_top];
+      hit = true;
+    } else {
+      BTBEntry *e = btb_entry(pc);
+      if (e->valid && e->pc == pc) { pred_target = e->target; hit = true; }
+    }
+    if (!hit || pred_target != target) {
+      nr_target_miss[kind] ++;
+      miss = true;
+    }
+  }
+  if (kind == BR_RET && ras_count > 0) {
+    ras_top = (ras_top + ras_depth - 1) % ras_depth;
+    ras_count --;
+  }
+  if (taken && !(kind == BR_RET && ras_depth > 0)) {
+    *btb_entry(pc) = (BTBEntry) { .pc = pc, .target = target, .valid = true };
+  }
+  if ((kind == BR_CALL || kind == BR_IND_CALL) && ras_depth > 0) {
+    // 栈满时覆盖最老的一项
+    ras_top = (ras_top + 1) % ras_depth;
+    ras[ras_top] = pc + 4;
+    if (ras_count < ras_depth) ras_count ++;
+  }
+  if (miss) func_of(pc)->miss ++;
+  bpred_last_miss = miss;
+}
+
+static uint64_t key_miss(int f) { return func_stat[f].miss; }
+
+static void report_functions() {
+  if (nr_func == 0) {
+    printf("No symbols are loaded, use --elf to report MPKI by function\n");
+    return;
+  }
+  int order[CONFIG_BPRED_TOP];
+  int n = func_top(key_miss, order, CONFIG_BPRED_TOP);
+  printf("Mispredictions by function:\n");
+  printf("  %8s  %14s  %16s  %s\n", "MPKI", "mispredicted", "instructions", "function");
+  for (int i = 0; i < n; i ++) {
+    FuncStat *f = &func_stat[order[i]];
+    if (f->miss == 0) break;
+    printf("  %8.2f  %14" PRIu64 "  %16" PRIu64 "  %s\n", (f->inst ? 1000.0 * f->miss / f->inst : 0.0),
+        f->miss, f->inst, func_name(order[i]));
+  }
+}
+
+void bpred_report() {
+  if (!bpred_active) return;
+  bpred_active = false;
+  uint64_t total = 0, total_miss = 0;
+  for (int i = 0; i < NR_BR_KIND; i ++) {
+    total += nr_branch[i];
+    total_miss += nr_dir_miss[i] + nr_target_miss[i];
+  }
+  Log("Branch prediction: %" PRIu64 " instructions, %" PRIu64 " branches, %" PRIu64 " mispredicted, MPKI = %.2f",
+      nr_inst, total, total_miss, (nr_inst ? 1000.0 * total_miss / nr_inst : 0.0));
+  printf("  %-14s  %14s  %14s  %14s  %8s\n", "kind", "count", "direction", "target", "miss%");
+  for (int i = 0; i < NR_BR_KIND; i ++) {
+    if (nr_branch[i] == 0) continue;
+    uint64_t miss = nr_dir_miss[i] + nr_target_miss[i];
+    printf("  %-14s  %14" PRIu64 "  %14" PRIu64 "  %14" PRIu64 "  %7.2f%%\n", kind_name[i], nr_branch[i],
+        nr_dir_miss[i], nr_target_miss[i], 100.0 * miss / nr_branch[i]);
+  }
+  if (total_miss > 0) report_functions();
+  free(pht); free(btb); free(ras); free(func_stat);
+  for (int i = 0; i < TAGE_NR_TABLE; i ++) { free(tage[i]); tage[i] = NULL; }
+  pht = NULL; btb = NULL; ras = NULL; func_stat = NULL;
+}
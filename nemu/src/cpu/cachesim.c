@@ -0,0 +1,289 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <isa.h>
+#include <memory/vaddr.h>
+#include <memory/paddr.h>
+#include <cpu/cachesim.h>
+#include <monitor/ftrace.h>
+
+enum { POLICY_LRU, POLICY_FIFO, POLICY_RANDOM };
+
+static const char *policy_name[] = { "lru", "fifo", "random" };
+
+typedef struct {
+  word_t tag;       // 行地址，即地址右移 line_shift 位
+  bool valid, dirty;
+  uint64_t stamp;   // LRU 为最近一次访问的时间，FIFO 为填入的时间
+} CacheLine;
+
+typedef struct Cache {
+  const char *name;
+  bool present;
+  uint64_t size;
+  int ways, line_shift, nr_set, policy;
+  CacheLine *line;     // nr_set 组，每组 ways 行
+  struct Cache *next;  // 缺失和写回访问的下一级缓存，NULL 表示内存
+  uint64_t access[2], miss[2];  // 下标 0 为读，1 为写
+  uint64_t writeback;
+} Cache;
+
+static Cache cache[NR_CACHE] = {
+  [CACHE_L1I] = { .name = "l1i" }, [CACHE_L1D] = { .name = "l1d" }, [CACHE_L2] = { .name = "l2" },
+};
+
+bool cachesim_active = false;
+static bool enabled = false;
+static uint64_t sample_interval = 0, sample_len = 0;
+static uint64_t nr_inst = 0, now = 0;
+static uint32_t rand_state = 1;
+// 每个函数在每个缓存中的缺失数，没有符号的地址记在最后一项
+static uint64_t (*func_miss)[NR_CACHE] = NULL;
+static int nr_func = 0;
+
+extern uint64_t g_nr_guest_inst;
+
+// 解析 "32K" 这样的大小，失败时返回 0
+static uint64_t parse_size(const char *s) {
+  char *end;
+  uint64_t v = strtoull(s, &end, 0);
+  if (*end == 'K' || *end == 'k') { v <<= 10; end ++; }
+  else if (*end == 'M' || *end == 'm') { v <<= 20; end ++; }
+  return (*end == '\0' ? v : 0);
+}
+
+static bool is_pow2(uint64_t x) { return x != 0 && (x & (x - 1)) == 0; }
+
+/* 解析一项 --cache 选项：
+ *   l1i|l1d|l2:SIZE:WAYS:LINE[:lru|fifo|random]  配置一个缓存
+ *   sample:INTERVAL:LENGTH                       每 INTERVAL 条指令只模拟开头的 LENGTH 条
+ */
+bool cachesim_parse(const char *spec) {
+  char buf[128];
+  snprintf(buf, sizeof(buf), "%s", spec);
+  char *arg[5] = {};
+  int nr_arg = 0;
+  for (char *t = strtok(buf, ":"); t != NULL && nr_arg < 5; t = strtok(NULL, ":")) arg[nr_arg ++] = t;
+
+  if (nr_arg == 3 && strcmp(arg[0], "sample") == 0) {
+    sample_interval = strtoull(arg[1], NULL, 0);
+    sample_len = strtoull(arg[2], NULL, 0);
+    if (sample_len == 0 || sample_len > sample_interval) {
+      printf("Invalid cache sampling '%s', 0 < LENGTH <= INTERVAL is required\n", spec);
+      return false;
+    }
+    return true;
+  }
+
+  Cache *c = NULL;
+  for (int i = 0; i < NR_CACHE; i ++) {
+    if (nr_arg > 0 && strcmp(arg[0], cache[i].name) == 0) c = &cache[i];
+  }
+  if (c == NULL || nr_arg < 4) {
+    printf("Invalid cache '%s', the format is l1i|l1d|l2:SIZE:WAYS:LINE[:lru|fifo|random] "
+        "or sample:INTERVAL:LENGTH\n", spec);
+    return false;
+  }
+  uint64_t size = parse_size(arg[1]);
+  int ways = atoi(arg[2]);
+  uint64_t line = parse_size(arg[3]);
+  int policy = POLICY_LRU;
+  if (nr_arg == 5) {
+    for (policy = 0; policy < ARRLEN(policy_name) && strcmp(arg[4], policy_name[policy]) != 0; policy ++) ;
+    if (policy == ARRLEN(policy_name)) {
+      printf("Unknown replacement policy '%s'\n", arg[4]);
+      return false;
+    }
+  }
+  if (!is_pow2(line) || line < 4 || ways <= 0 || size % (ways * line) != 0 || !is_pow2(size / (ways * line))) {
+    printf("Invalid cache '%s', LINE and SIZE / (WAYS * LINE) must be powers of 2\n", spec);
+    return false;
+  }
+  c->present = true;
+  c->size = size;
+  c->ways = ways;
+  c->line_shift = __builtin_ctzll(line);
+  c->nr_set = size / (ways * line);
+  c->policy = policy;
+  return true;
+}
+
+void init_cachesim() {
+  for (int i = 0; i < NR_CACHE; i ++) enabled |= cache[i].present;
+  if (!enabled) return;
+  Cache *l2 = (cache[CACHE_L2].present ? &cache[CACHE_L2] : NULL);
+  for (int i = 0; i < NR_CACHE; i ++) {
+    Cache *c = &cache[i];
+    if (!c->present) continue;
+    c->line = calloc((size_t)c->nr_set * c->ways, sizeof(CacheLine));
+    Assert(c->line, "Can not allocate the %s cache", c->name);
+    c->next = (i == CACHE_L2 ? NULL : l2);
+    Log("Cache %s: %" PRIu64 " bytes, %d-way, %d-byte lines, %s", c->name, c->size, c->ways,
+        1 << c->line_shift, policy_name[c->policy]);
+  }
+  nr_func = func_nr();
+  func_miss = calloc(nr_func + 1, sizeof(func_miss[0]));
+  assert(func_miss);
+  if (sample_interval > 0) {
+    Log("Cache simulation samples the first %" PRIu64 " of every %" PRIu64 " instructions",
+        sample_len, sample_interval);
+  }
+  atexit(cachesim_report);
+}
+
+/* 选择执行循环之前调用：更新是否在采样区间内，并把 *n 截到区间的边界上。
+ * 返回是否需要逐条指令执行。
+ */
+bool cachesim_need_step(uint64_t *n) {
+  if (!enabled) return false;
+  if (sample_interval == 0) { cachesim_active = true; return true; }
+  uint64_t pos = g_nr_guest_inst % sample_interval;
+  uint64_t left = (pos < sample_len ? sample_len - pos : sample_interval - pos);
+  if (*n > left) *n = left;
+  cachesim_active = (pos < sample_len);
+  return cachesim_active;
+}
+
+bool cachesim_enabled() {
+  return enabled;
+}
+
+static CacheLine* choose_victim(Cache *c, CacheLine *set) {
+  for (int i = 0; i < c->ways; i ++) {
+    if (!set[i].valid) return &set[i];
+  }
+  if (c->policy == POLICY_RANDOM) {
+    // xorshift32
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 17;
+    rand_state ^= rand_state << 5;
+    return &set[rand_state % c->ways];
+  }
+  // LRU 和 FIFO 都替换时间戳最小的行，区别只在于命中时是否更新时间戳
+  CacheLine *victim = &set[0];
+  for (int i = 1; i < c->ways; i ++) {
+    if (set[i].stamp < victim->stamp) victim = &set[i];
+  }
+  return victim;
+}
+
+// 写回、写分配。缺失按执行访存的指令 pc 计入函数
+static void cache_access(Cache *c, word_t addr, bool is_write, vaddr_t pc) {
+  word_t tag = addr >> c->line_shift;
+  CacheLine *set = &c->line[(tag & (c->nr_set - 1)) * c->ways];
+  now ++;
+  c->access[is_write] ++;
+  for (int i = 0; i < c->ways; i ++) {
+    if (set[i].valid && set[i].tag == tag) {
+      if (c->policy == POLICY_LRU) set[i].stamp = now;
+      set[i].dirty |= is_write;
+      return;
+    }
+  }
+  c->miss[is_write] ++;
+  func_miss[func_index(find_function(pc))][c - cache] ++;
+  CacheLine *victim = choose_victim(c, set);
+  if (victim->valid && victim->dirty) {
+    c->writeback ++;
+    if (c->next != NULL) cache_access(c->next, victim->tag << c->line_shift, true, pc);
+  }
+  if (c->next != NULL) cache_access(c->next, addr, false, pc);
+  *victim = (CacheLine) { .tag = tag, .valid = true, .dirty = is_write, .stamp = now };
+}
+
+// 跨越缓存行的访问拆成对每一行的访问
+static void cache_range(Cache *c, word_t addr, int len, bool is_write, vaddr_t pc) {
+  word_t last = (addr + len - 1) >> c->line_shift;
+  for (word_t l = addr >> c->line_shift; l <= last; l ++) {
+    cache_access(c, l << c->line_shift, is_write, pc);
+  }
+}
+
+// 没有配置 L1 时直接访问 L2
+static Cache* first_level(int l1) {
+  if (cache[l1].present) return &cache[l1];
+  return (cache[CACHE_L2].present ? &cache[CACHE_L2] : NULL);
+}
+
+// 和数据访问一样按物理地址模拟，取指会出错时这条指令不执行，不模拟
+void cachesim_ifetch(vaddr_t pc) {
+  nr_inst ++;
+  paddr_t paddr;
+  if (!vaddr_peek(pc, MEM_TYPE_IFETCH, &paddr) || !in_pmem(paddr)) return;
+  Cache *c = first_level(CACHE_L1I);
+  if (c != NULL) cache_range(c, paddr, 4, false, pc);
+}
+
+void cachesim_data(paddr_t addr, int len, bool is_write) {
+  Cache *c = first_level(CACHE_L1D);
+  if (c != NULL) cache_range(c, addr, len, is_write, cpu.pc);
+}
+
+uint64_t cachesim_misses(int id) {
+  return cache[id].miss[0] + cache[id].miss[1];
+}
+
+static uint64_t total_miss(const uint64_t *m) {
+  uint64_t sum = 0;
+  for (int i = 0; i < NR_CACHE; i ++) sum += m[i];
+  return sum;
+}
+
+static uint64_t key_miss(int f) { return total_miss(func_miss[f]); }
+
+static void report_functions() {
+  if (nr_func == 0) {
+    printf("No symbols are loaded, use --elf to report misses by function\n");
+    return;
+  }
+  int order[CONFIG_CACHE_SIM_TOP];
+  int n = func_top(key_miss, order, CONFIG_CACHE_SIM_TOP);
+  printf("Misses by function:\n ");
+  for (int i = 0; i < NR_CACHE; i ++) {
+    if (cache[i].present) printf(" %14s", cache[i].name);
+  }
+  printf("  function\n");
+  for (int i = 0; i < n; i ++) {
+    int f = order[i];
+    if (total_miss(func_miss[f]) == 0) break;
+    printf(" ");
+    for (int j = 0; j < NR_CACHE; j ++) {
+      if (cache[j].present) printf(" %14" PRIu64, func_miss[f][j]);
+    }
+    printf("  %s\n", func_name(f));
+  }
+}
+
+void cachesim_report() {
+  if (!enabled) return;
+  enabled = false;
+  cachesim_active = false;
+  Log("Cache simulation: %" PRIu64 " instructions simulated", nr_inst);
+  for (int i = 0; i < NR_CACHE; i ++) {
+    Cache *c = &cache[i];
+    if (!c->present) continue;
+    uint64_t access = c->access[0] + c->access[1], miss = c->miss[0] + c->miss[1];
+    printf("  %-4s accesses %14" PRIu64 "  misses %12" PRIu64 " (%6.2f%%)  MPKI %8.2f\n",
+        c->name, access, miss, (access ? 100.0 * miss / access : 0.0), (nr_inst ? 1000.0 * miss / nr_inst : 0.0));
+    printf("       read misses %12" PRIu64 "  write misses %12" PRIu64 "  writebacks %12" PRIu64 "\n",
+        c->miss[0], c->miss[1], c->writeback);
+    free(c->line);
+    c->line = NULL;
+  }
+  if (nr_inst > 0) report_functions();
+  free(func_miss);
+  func_miss = NULL;
+}
@@ -0,0 +1,261 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <isa.h>
+#include <cpu/callprof.h>
+#include <monitor/ftrace.h>
+
+// 调用上下文树的节点，子节点总是在父节点之后创建，所以 parent 小于自己的下标
+typedef struct {
+  FuncInfo *func;   // NULL 表示没有符号
+  int parent, child, sibling;
+  uint64_t self;    // 在这个上下文中直接执行的指令数
+  uint64_t calls;   // 从父上下文进入这个上下文的次数
+} Node;
+
+// 影子调用栈，ret_addr 用来和返回指令的目标匹配
+typedef struct {
+  int node;
+  vaddr_t ret_addr;
+} Frame;
+
+// 报告中按函数汇总的一条调用边
+typedef struct {
+  int caller, callee;
+  uint64_t calls, incl;
+} Arc;
+
+uint64_t *callprof_self = NULL;
+static Node *node = NULL;
+static int nr_node = 0, max_node = 0;
+static Frame *stack = NULL;
+static int depth = 0, max_depth = 0;
+static const char *folded_file = NULL;
+
+static int new_node(FuncInfo *func, int parent) {
+  if (nr_node == max_node) {
+    max_node = (max_node == 0 ? 1024 : max_node * 2);
+    node = realloc(node, sizeof(Node) * max_node);
+    Assert(node, "Can not allocate the call profile");
+  }
+  int n = nr_node ++;
+  node[n] = (Node) { .func = func, .parent = parent, .child = -1, .sibling = -1 };
+  if (parent >= 0) {
+    node[n].sibling = node[parent].child;
+    node[parent].child = n;
+  }
+  return n;
+}
+
+static void push(int n, vaddr_t ret_addr) {
+  if (depth == max_depth) {
+    max_depth = (max_depth == 0 ? 256 : max_depth * 2);
+    stack = realloc(stack, sizeof(Frame) * max_depth);
+    Assert(stack, "Can not allocate the shadow call stack");
+  }
+  stack[depth ++] = (Frame) { .node = n, .ret_addr = ret_addr };
+}
+
+void init_callprof(const char *file) {
+  if (!ftrace_state.enabled) {
+    printf("No symbols are loaded, use --elf to profile calls by function\n");
+  }
+  folded_file = file;
+  // 根上下文是入口所在的函数，它不会返回
+  int root = new_node(find_function(cpu.pc), -1);
+  node[root].calls = 1;
+  push(root, 0);
+  callprof_self = &node[root].self;
+  atexit(callprof_report);
+  Log("Call profiling is enabled, folded stacks are dumped to %s", file);
+}
+
+void callprof_call(vaddr_t target, vaddr_t ret_addr) {
+  FuncInfo *func = find_function(target);
+  int cur = stack[depth - 1].node;
+  int prev = -1, n = node[cur].child;
+  for (; n >= 0 && node[n].func != func; prev = n, n = node[n].sibling) ;
+  if (n < 0) n = new_node(func, cur);
+  else if (prev >= 0) {
+    // 移到链表头部，循环中反复调用的函数下一次能更快找到
+    node[prev].sibling = node[n].sibling;
+    node[n].sibling = node[cur].child;
+    node[cur].child = n;
+  }
+  node[n].calls ++;
+  push(n, ret_addr);
+  callprof_self = &node[n].self;
+}
+
+/* 返回到最近的一个返回地址相同的帧的调用者。尾调用和 longjmp 会跳过若干帧，
+ * 它们在这里被一起弹出；找不到匹配的帧（例如调用没有被看到）时保持不变。
+ */
+void callprof_ret(vaddr_t target) {
+  for (int i = depth - 1; i > 0; i --) {
+    if (stack[i].ret_addr == target) {
+      depth = i;
+      callprof_self = &node[stack[depth - 1].node].self;
+      return;
+    }
+  }
+}
+
+static inline int node_func(int n) {
+  return func_index(node[n].func);
+}
+
+static uint64_t *f_self, *f_incl, *f_calls;
+
+static uint64_t key_self(int f) { return f_self[f]; }
+static uint64_t key_incl(int f) { return f_incl[f]; }
+
+static int arc_cmp(const void *a, const void *b) {
+  const Arc *x = a, *y = b;
+  if (x->caller != y->caller) return x->caller - y->caller;
+  return x->callee - y->callee;
+}
+
+static void report_flat(uint64_t total) {
+  int order[CONFIG_CALL_PROFILE_TOP];
+  int n = func_top(key_self, order, CONFIG_CALL_PROFILE_TOP);
+  printf("Flat profile:\n");
+  printf("  %7s  %16s  %7s  %16s  %12s  %s\n", "self%", "self", "incl%", "inclusive", "calls", "function");
+  for (int i = 0; i < n; i ++) {
+    int f = order[i];
+    if (f_incl[f] == 0) break;
+    printf("  %6.2f%%  %16" PRIu64 "  %6.2f%%  %16" PRIu64 "  %12" PRIu64 "  %s\n",
+        100.0 * f_self[f] / total, f_self[f], 100.0 * f_incl[f] / total, f_incl[f], f_calls[f], func_name(f));
+  }
+}
+
+/* 与 gprof 的调用图类似：每个函数上面是它的调用者，下面是它调用的函数。
+ * 调用边上的 inclusive 是通过这条边进入被调用者之后执行的指令数，递归调用不重复计算。
+ */
+static void report_graph(uint64_t total, Arc *arc, int nr_arc) {
+  int order[CONFIG_CALL_PROFILE_TOP];
+  int n = func_top(key_incl, order, CONFIG_CALL_PROFILE_TOP);
+  printf("Call graph:\n");
+  printf("  %-6s  %7s  %16s  %16s  %21s  %s\n", "index", "incl%", "inclusive", "self", "calls", "function");
+  for (int i = 0; i < n; i ++) {
+    int f = order[i];
+    if (f_incl[f] == 0) break;
+    for (int j = 0; j < nr_arc; j ++) {
+      if (arc[j].callee != f) continue;
+      printf("  %6s  %7s  %16" PRIu64 "  %16s  %10" PRIu64 "/%-10" PRIu64 "      %s\n",
+          "", "", arc[j].incl, "", arc[j].calls, f_calls[f], func_name(arc[j].caller));
+    }
+    char idx[16];
+    snprintf(idx, sizeof(idx), "[%d]", i + 1);
+    printf("  %-6s  %6.2f%%  %16" PRIu64 "  %16" PRIu64 "  %21" PRIu64 "  %s\n",
+        idx, 100.0 * f_incl[f] / total, f_incl[f], f_self[f], f_calls[f], func_name(f));
+    for (int j = 0; j < nr_arc; j ++) {
+      if (arc[j].caller != f) continue;
+      printf("  %6s  %7s  %16" PRIu64 "  %16s  %10" PRIu64 "/%-10" PRIu64 "      %s\n",
+          "", "", arc[j].incl, "", arc[j].calls, f_calls[arc[j].callee], func_name(arc[j].callee));
+    }
+    printf("\n");
+  }
+}
+
+// 程序结束或退出 NEMU 时输出报告，只输出一次
+void callprof_report() {
+  if (callprof_self == NULL) return;
+  callprof_self = NULL;
+  int nr_func = func_nr();
+
+  // 每个上下文包括子树在内的指令数
+  uint64_t *tot = malloc(sizeof(uint64_t) * nr_node);
+  assert(tot);
+  for (int i = 0; i < nr_node; i ++) tot[i] = node[i].self;
+  for (int i = nr_node - 1; i > 0; i --) tot[node[i].parent] += tot[i];
+  uint64_t total = tot[0];
+
+  f_self = calloc(nr_func + 1, sizeof(uint64_t));
+  f_incl = calloc(nr_func + 1, sizeof(uint64_t));
+  f_calls = calloc(nr_func + 1, sizeof(uint64_t));
+  int *on_path = calloc(nr_func + 1, sizeof(int));
+  Arc *arc = malloc(sizeof(Arc) * nr_node);
+  int *plen = malloc(sizeof(int) * (nr_node + 1));
+  assert(f_self && f_incl && f_calls && on_path && arc && plen);
+  int nr_arc = 0;
+
+  FILE *fp = fopen(folded_file, "w");
+  if (fp == NULL) printf("Can not open '%s' to dump the folded stacks\n", folded_file);
+  size_t path_size = 4096;
+  char *path = malloc(path_size);
+  assert(path);
+  plen[0] = 0;
+
+  /* 不用递归地深度优先遍历调用上下文树。一个函数只在它最外层的上下文结束时
+   * 累加 inclusive，所以递归调用不会被重复计算。
+   */
+  int i = 0, d = 0;
+  while (true) {
+    // 进入节点 i
+    int f = node_func(i);
+    on_path[f] ++;
+    f_self[f] += node[i].self;
+    f_calls[f] += node[i].calls;
+    if (i > 0) {
+      arc[nr_arc ++] = (Arc) { .caller = node_func(node[i].parent), .callee = f,
+        .calls = node[i].calls, .incl = (on_path[f] == 1 ? tot[i] : 0) };
+    }
+    const char *name = func_name(f);
+    size_t need = plen[d] + strlen(name) + 2;
+    if (need > path_size) {
+      while (need > path_size) path_size *= 2;
+      path = realloc(path, path_size);
+      assert(path);
+    }
+    plen[d + 1] = plen[d] + sprintf(path + plen[d], "%s%s", (d == 0 ? "" : ";"), name);
+    if (fp != NULL && node[i].self > 0) fprintf(fp, "%.*s %" PRIu64 "\n", plen[d + 1], path, node[i].self);
+
+    if (node[i].child >= 0) { i = node[i].child; d ++; continue; }
+    // 离开所有子节点都已经访问过的节点
+    while (true) {
+      f = node_func(i);
+      if (-- on_path[f] == 0) f_incl[f] += tot[i];
+      if (i == 0) break;
+      if (node[i].sibling >= 0) { i = node[i].sibling; break; }
+      i = node[i].parent;
+      d --;
+    }
+    if (i == 0) break;
+  }
+  if (fp != NULL) fclose(fp);
+
+  // 合并同一对函数之间的调用边
+  qsort(arc, nr_arc, sizeof(Arc), arc_cmp);
+  int nr_merged = 0;
+  for (int j = 0; j < nr_arc; j ++) {
+    if (nr_merged > 0 && arc_cmp(&arc[nr_merged - 1], &arc[j]) == 0) {
+      arc[nr_merged - 1].calls += arc[j].calls;
+      arc[nr_merged - 1].incl += arc[j].incl;
+    } else arc[nr_merged ++] = arc[j];
+  }
+
+  if (total > 0) {
+    Log("Call profile: %" PRIu64 " instructions in %d calling contexts", total, nr_node);
+    report_flat(total);
+    report_graph(total, arc, nr_merged);
+  }
+
+  free(path); free(plen); free(arc); free(on_path);
+  free(f_self); free(f_incl); free(f_calls); free(tot);
+  free(node); free(stack);
+  node = NULL; stack = NULL;
+  nr_node = max_node = depth = max_depth = 0;
+}
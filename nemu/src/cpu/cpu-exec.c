@@ -19,6 +19,14 @@
 #include <locale.h>
 #include <../src/monitor/sdb/sdb.h>
 #include <cpu/iringbuf.h>
+#include <cpu/tb.h>
+#include <cpu/simpoint.h>
+#include <cpu/pcprof.h>
+#include <cpu/callprof.h>
+#include <cpu/inststat.h>
+#include <cpu/cachesim.h>
+#include <cpu/bpred.h>
+#include <cpu/timing.h>
 #include <monitor/ftrace.h>
 
 /* The assembly code of instructions executed is only output to the screen
@@ -28,43 +36,35 @@
  */
 #define MAX_INST_TO_PRINT 10
 
+/* The fast execution loop checks the NEMU state once after executing
+ * at most this many instructions.
+ */
+#define TB_EXEC_BATCH 1024
+
 CPU_state cpu = {};
 uint64_t g_nr_guest_inst = 0;
 static uint64_t g_timer = 0; // unit: us
 static bool g_print_step = false;
 
+#ifdef CONFIG_DEVICE
 void device_update();
+void device_resume();
+extern uint64_t device_quantum;
+// 距离下一次调用 device_update() 还要执行的指令数
+static uint64_t device_countdown = 1;
 
-static void trace_and_difftest(Decode *_this, vaddr_t dnpc) {
-#ifdef CONFIG_ITRACE_COND
-  if (ITRACE_COND) { log_write("%s\n", _this->logbuf); }
-#endif
-  if (g_print_step) { IFDEF(CONFIG_ITRACE, puts(_this->logbuf)); }
-  IFDEF(CONFIG_DIFFTEST, difftest_step(_this->pc, dnpc));
-
-#ifdef CONFIG_WATCHPOINT
-  // 检查监视点，如果有监视点触发，暂停程序
-  if (check_watchpoints()) {
-    nemu_state.state = NEMU_STOP;
+static inline void device_tick(uint64_t nr_inst) {
+  device_countdown -= nr_inst;
+  if (device_countdown == 0) {
+    device_update();
+    device_countdown = device_quantum;
   }
-#endif
 }
+#endif
 
-
-/*
-设置并执行当前指令
-更新 CPU 的程序计数器
-如果启用了指令追踪，生成详细的日志，包括：
-指令地址
-指令的十六进制表示
-指令的汇编代码表示（通过反汇编）
-*/
-static void exec_once(Decode *s, vaddr_t pc) {
-  s->pc = pc;//将当前 PC 值设置到 s->pc
-  s->snpc = pc;//将相同的 PC 值设置到 s->snpc（静态下一个 PC，即当前指令的地址）
-  isa_exec_once(s);
-  cpu.pc = s->dnpc;//执行完成后，将动态计算出的下一个 PC 值 s->dnpc 更新到 CPU 的 PC 寄存器
-#ifdef CONFIG_ITRACE//用于生成指令追踪日志
+#ifdef CONFIG_ITRACE
+// 生成 itrace 的文本：地址、指令的十六进制表示和反汇编
+static void itrace_format(Decode *s) {
   char *p = s->logbuf;//指针指向日志缓冲区
   p += snprintf(p, sizeof(s->logbuf), FMT_WORD ":", s->pc);//将pc值格式到日志中
   int ilen = s->snpc - s->pc;//计算指令长度并获取指令字节
@@ -87,19 +87,138 @@ static void exec_once(Decode *s, vaddr_t pc) {
   void disassemble(char *str, int size, uint64_t pc, uint8_t *code, int nbyte);//反汇编
   disassemble(p, s->logbuf + sizeof(s->logbuf) - p,
       MUXDEF(CONFIG_ISA_x86, s->snpc, s->pc), (uint8_t *)&s->isa.inst, ilen);
+}
+#endif
+
+static void trace_and_difftest(Decode *_this, vaddr_t dnpc) {
+#ifdef CONFIG_ITRACE
+  // 只有要打印或写入日志时才生成文本，反汇编的开销很大
+  bool to_log = (trace_inst_active & TRACE_ITRACE) && (ITRACE_COND);
+  if (g_print_step || to_log) itrace_format(_this);
+  if (to_log) { log_write("%s\n", _this->logbuf); }
+#endif
+  if (g_print_step) { IFDEF(CONFIG_ITRACE, puts(_this->logbuf)); }
+  IFDEF(CONFIG_DIFFTEST, difftest_step(_this->pc, dnpc));
+
+#ifdef CONFIG_WATCHPOINT
+  // 检查监视点，如果有监视点触发，暂停程序
+  if (check_watchpoints()) {
+    nemu_state.state = NEMU_STOP;
+  }
+#endif
+#ifdef CONFIG_BREAKPOINT
+  // 下一条要执行的指令上有断点时，在执行它之前停下
+  if (has_breakpoints() && check_breakpoints(dnpc)) {
+    nemu_state.state = NEMU_STOP;
+  }
+#endif
+}
+
+/*
+设置并执行当前指令
+更新 CPU 的程序计数器
+如果启用了指令追踪，把指令记入环形缓冲区
+*/
+static void exec_once(Decode *s, vaddr_t pc) {
+  s->pc = pc;//将当前 PC 值设置到 s->pc
+  s->snpc = pc;//将相同的 PC 值设置到 s->snpc（静态下一个 PC，即当前指令的地址）
+  IFDEF(CONFIG_ITRACE, iringbuf_entry_t *e = iringbuf_record(pc));
+  isa_exec_once(s);
+  cpu.pc = s->dnpc;//执行完成后，将动态计算出的下一个 PC 值 s->dnpc 更新到 CPU 的 PC 寄存器
+  IFDEF(CONFIG_ITRACE, iringbuf_fill(e, &s->isa.inst, s->snpc - s->pc));
+}
 
-      iringbuf_record(pc, s->isa.inst, p);
+/* 接下来的 *n 条指令是否需要逐条执行的调试功能：si 单步打印、itrace、
+ * difftest、表达式监视点、SimPoint 采样、pc 计数、调用图、二进制追踪、缓存模拟、分支预测、时序模型。
+ * 这些功能在执行过程中不会改变，但追踪窗口和缓存模拟的采样区间可以按指令数
+ * 打开和关闭，所以 *n 会被截到它们的边界上，跨过边界后由 execute() 重新选择执行循环。
+ */
+static bool inst_hooks_enabled(uint64_t *n) {
+  // 要先更新是否在采样区间内，区间外访存不模拟
+  IFDEF(CONFIG_CACHE_SIM, if (cachesim_need_step(n)) return true);
+  if (g_print_step) return true;
+  if (ISDEF(CONFIG_DIFFTEST)) return true;
+  IFDEF(CONFIG_WATCHPOINT, if (has_watchpoints()) return true);
+  IFDEF(CONFIG_SIMPOINT, if (simpoint_enabled()) return true);
+  IFDEF(CONFIG_PC_PROFILE, if (pcprof_enabled()) return true);
+  IFDEF(CONFIG_CALL_PROFILE, if (callprof_enabled()) return true);
+  IFDEF(CONFIG_BPRED, if (bpred_active) return true);
+  IFDEF(CONFIG_TIMING, if (timing_active) return true);
+  IFDEF(CONFIG_TRACE_BINARY, if (tracebin_enabled()) return true);
+  IFDEF(CONFIG_TRACE, if (trace_need_step(n)) return true);
+  return false;
+}
+
+// 不带任何插桩地执行至多 n 条指令，返回实际执行的条数
+static uint64_t exec_batch(uint64_t n) {
+#ifdef CONFIG_ENGINE_THREADED
+  return tb_exec(n);
+#else
+  Decode s;
+  uint64_t i;
+  for (i = 0; i < n && nemu_state.state == NEMU_RUNNING; i ++) {
+    s.pc = s.snpc = cpu.pc;
+    IFDEF(CONFIG_ITRACE, iringbuf_entry_t *e = iringbuf_record(s.pc));
+    isa_exec_once(&s);
+    cpu.pc = s.dnpc;
+    IFDEF(CONFIG_ITRACE, iringbuf_fill(e, &s.isa.inst, s.snpc - s.pc));
+#ifdef CONFIG_BREAKPOINT
+    // 同 tb_exec()：命中断点后返回，由 execute() 重新选择执行循环
+    if (has_breakpoints() && bp_at(cpu.pc)) {
+      if (bp_hit(cpu.pc)) nemu_state.state = NEMU_STOP;
+      return i + 1;
+    }
+#endif
+  }
+  return i;
 #endif
 }
 
-static void execute(uint64_t n) {
+// 快速执行循环：一批指令执行完才更新计数、检查状态和设备
+static uint64_t execute_fast(uint64_t n) {
+  uint64_t total = 0;
+  while (n > 0) {
+    uint64_t batch = MUXDEF(CONFIG_DEVICE, device_countdown, TB_EXEC_BATCH);
+    if (batch > n) batch = n;
+    uint64_t nr_exec = exec_batch(batch);
+    g_nr_guest_inst += nr_exec;
+    total += nr_exec;
+    n -= nr_exec;
+    if (nemu_state.state != NEMU_RUNNING) break;
+    IFDEF(CONFIG_DEVICE, device_tick(nr_exec));
+    // 批次提前结束(命中了断点)，回到 execute() 重新检查需要的插桩
+    if (nr_exec < batch) break;
+  }
+  return total;
+}
+
+// 插桩执行循环：每条指令之后都运行 trace_and_difftest()
+static uint64_t execute_slow(uint64_t n) {
   Decode s;
-  for (;n > 0; n --) {
+  uint64_t i;
+  for (i = 0; i < n; i ++) {
+    IFDEF(CONFIG_TRACE, trace_step(cpu.pc));
+    // 在执行之前计数，调用指令算在调用者里，返回指令算在被调用者里
+    IFDEF(CONFIG_CALL_PROFILE, if (callprof_enabled()) callprof_exec());
+    // 译码缓存命中时不会取指，指令缓存按 pc 翻译后的物理地址模拟
+    IFDEF(CONFIG_CACHE_SIM, if (cachesim_active) cachesim_ifetch(cpu.pc));
+    IFDEF(CONFIG_BPRED, if (bpred_active) bpred_inst(cpu.pc));
     exec_once(&s, cpu.pc);
     g_nr_guest_inst ++;
+    IFDEF(CONFIG_SIMPOINT, if (simpoint_enabled()) simpoint_exec(&s));
+    IFDEF(CONFIG_PC_PROFILE, if (pcprof_enabled()) pcprof_exec(s.pc));
+    IFDEF(CONFIG_TRACE_BINARY, if (tracebin_enabled()) tracebin_inst(s.pc, (uint8_t *)&s.isa.inst, s.snpc - s.pc));
     trace_and_difftest(&s, cpu.pc);
-    if (nemu_state.state != NEMU_RUNNING) break;
-    IFDEF(CONFIG_DEVICE, device_update());
+    if (nemu_state.state != NEMU_RUNNING) { i ++; break; }
+    IFDEF(CONFIG_DEVICE, device_tick(1));
+  }
+  return i;
+}
+
+static void execute(uint64_t n) {
+  while (n > 0 && nemu_state.state == NEMU_RUNNING) {
+    uint64_t chunk = n;
+    n -= inst_hooks_enabled(&chunk) ? execute_slow(chunk) : execute_fast(chunk);
   }
 }
 
@@ -110,11 +229,15 @@ static void statistic() {
   Log("total guest instructions = " NUMBERIC_FMT, g_nr_guest_inst);
   if (g_timer > 0) Log("simulation frequency = " NUMBERIC_FMT " inst/s", g_nr_guest_inst * 1000000 / g_timer);
   else Log("Finish running in less than 1 us and can not calculate the simulation frequency");
+  IFDEF(CONFIG_RV_SV32, isa_mmu_statistic());
+  IFDEF(CONFIG_INST_STAT, inst_statistic());
 }
 
 void assert_fail_msg() {
+  IFDEF(CONFIG_ITRACE, if (iringbuf_count > 0) iringbuf_display());
   isa_reg_display();
   statistic();
+  IFNDEF(CONFIG_TARGET_AM, log_flush());
 }
 
 /* Simulate how the CPU works. */
@@ -128,11 +251,13 @@ void cpu_exec(uint64_t n) {
   }
 
   uint64_t timer_start = get_time();
+  IFDEF(CONFIG_DEVICE, device_resume());
 
   execute(n);
 
   uint64_t timer_end = get_time();
   g_timer += timer_end - timer_start;
+  IFDEF(CONFIG_TRACE_BINARY, tracebin_flush());
 
   switch (nemu_state.state) {
     case NEMU_RUNNING: nemu_state.state = NEMU_STOP; break;
@@ -146,7 +271,15 @@ void cpu_exec(uint64_t n) {
       // fall through
     case NEMU_QUIT: {
       statistic();
+      // 报告要用到 ftrace 的符号表，必须在 cleanup_ftrace() 之前
+      IFDEF(CONFIG_PC_PROFILE, pcprof_report());
+      IFDEF(CONFIG_CALL_PROFILE, callprof_report());
+      IFDEF(CONFIG_CACHE_SIM, cachesim_report());
+      IFDEF(CONFIG_BPRED, bpred_report());
+      IFDEF(CONFIG_TIMING, timing_report());
       cleanup_ftrace();
+      IFDEF(CONFIG_SIMPOINT, simpoint_finish());
+      IFNDEF(CONFIG_TARGET_AM, log_flush());
     }
   }
 }
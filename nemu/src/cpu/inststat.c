@@ -0,0 +1,94 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <isa.h>
+#include <cpu/inststat.h>
+
+uint64_t inst_stat[NR_INST_CLASS] = {};
+MemStat pmem_stat = {};
+static const char *json_file = NULL;
+
+static const char *class_name[NR_INST_CLASS] = {
+  [INST_ALU] = "alu", [INST_MULDIV] = "muldiv",
+  [INST_LOAD_B] = "load_b", [INST_LOAD_H] = "load_h", [INST_LOAD_W] = "load_w",
+  [INST_STORE_B] = "store_b", [INST_STORE_H] = "store_h", [INST_STORE_W] = "store_w",
+  [INST_BRANCH_TAKEN] = "branch_taken", [INST_BRANCH_NOT_TAKEN] = "branch_not_taken",
+  [INST_JUMP] = "jump", [INST_CSR] = "csr", [INST_ECALL] = "ecall",
+  [INST_SYSTEM] = "system", [INST_OTHER] = "other",
+};
+
+void init_inststat(const char *file) {
+  json_file = file;
+}
+
+static void print_mem(const char *name, const MemStat *m) {
+  printf("  %-12s  reads %14" PRIu64 " (%16" PRIu64 " bytes)  writes %14" PRIu64 " (%16" PRIu64 " bytes)\n",
+      name, m->nr_read, m->read_bytes, m->nr_write, m->write_bytes);
+}
+
+static void json_mem(FILE *fp, const char *name, const MemStat *m, bool last) {
+  fprintf(fp, "    \"%s\": { \"reads\": %" PRIu64 ", \"read_bytes\": %" PRIu64
+      ", \"writes\": %" PRIu64 ", \"write_bytes\": %" PRIu64 " }%s\n",
+      name, m->nr_read, m->read_bytes, m->nr_write, m->write_bytes, (last ? "" : ","));
+}
+
+static void dump_json(uint64_t total) {
+  FILE *fp = fopen(json_file, "w");
+  if (fp == NULL) {
+    printf("Can not open '%s' to dump the statistics\n", json_file);
+    return;
+  }
+  fprintf(fp, "{\n  \"instructions\": %" PRIu64 ",\n  \"mix\": {\n", total);
+  for (int i = 0; i < NR_INST_CLASS; i ++) {
+    fprintf(fp, "    \"%s\": %" PRIu64 "%s\n", class_name[i], inst_stat[i], (i == NR_INST_CLASS - 1 ? "" : ","));
+  }
+  fprintf(fp, "  },\n  \"memory\": {\n");
+  int nr_mmio = 0;
+#ifdef CONFIG_DEVICE
+  const char *name;
+  while (mmio_stat(nr_mmio, &name) != NULL) nr_mmio ++;
+#endif
+  json_mem(fp, "pmem", &pmem_stat, nr_mmio == 0);
+#ifdef CONFIG_DEVICE
+  for (int i = 0; i < nr_mmio; i ++) {
+    MemStat *m = mmio_stat(i, &name);
+    json_mem(fp, name, m, i == nr_mmio - 1);
+  }
+#endif
+  fprintf(fp, "  }\n}\n");
+  fclose(fp);
+}
+
+void inst_statistic() {
+  uint64_t total = 0;
+  for (int i = 0; i < NR_INST_CLASS; i ++) total += inst_stat[i];
+  if (total == 0) return;
+  Log("Instruction mix:");
+  for (int i = 0; i < NR_INST_CLASS; i ++) {
+    if (inst_stat[i] == 0) continue;
+    printf("  %-16s  %16" PRIu64 "  %6.2f%%\n", class_name[i], inst_stat[i], 100.0 * inst_stat[i] / total);
+  }
+  Log("Memory traffic:");
+  print_mem("pmem", &pmem_stat);
+#ifdef CONFIG_DEVICE
+  const char *name;
+  MemStat *m;
+  for (int i = 0; (m = mmio_stat(i, &name)) != NULL; i ++) {
+    if (m->nr_read + m->nr_write > 0) print_mem(name, m);
+  }
+#endif
+  if (json_file != NULL) dump_json(total);
+}
@@ -1,54 +1,47 @@
 #include <cpu/iringbuf.h>
 #include <isa.h>
 
-static iringbuf_entry_t iringbuf[IRINGBUF_SIZE] = {};
-static int iringbuf_idx = 0;  // 当前写入位置
-static bool iringbuf_full = false;  // 标记缓冲区是否已满
+static_assert((IRINGBUF_SIZE & (IRINGBUF_SIZE - 1)) == 0, "IRINGBUF_SIZE must be a power of 2");
 
-void iringbuf_record(vaddr_t pc, uint32_t inst, const char *asm_buf) {
-  // 记录当前指令
-  iringbuf[iringbuf_idx].pc = pc;// 保存程序计数器值(指令地址)
-  iringbuf[iringbuf_idx].inst = inst;// 保存指令的二进制表示
-  //安全复制反汇编文本:
-  strncpy(iringbuf[iringbuf_idx].asm_buf, asm_buf, sizeof(iringbuf[0].asm_buf) - 1);
-  iringbuf[iringbuf_idx].asm_buf[sizeof(iringbuf[0].asm_buf) - 1] = '\0';
-  
-  // 更新索引，实现环形效果
-  iringbuf_idx = (iringbuf_idx + 1) % IRINGBUF_SIZE;
-  
-  // 如果索引回到0，说明缓冲区已经被填满过一次
-  if (iringbuf_idx == 0) {
-    iringbuf_full = true;
-  }
-}
+iringbuf_entry_t iringbuf[IRINGBUF_SIZE] = {};
+uint64_t iringbuf_count = 0;
 
 void iringbuf_display() {
   printf("====== Instruction Ring Buffer ======\n");
   
-  int start, count;
-  if (iringbuf_full) {
-    // 如果缓冲区已满，从当前索引开始显示所有条目
-    start = iringbuf_idx;
-    count = IRINGBUF_SIZE;
-  } else {
-    // 否则只显示从0到当前索引的条目
-    start = 0;
-    count = iringbuf_idx;
-  }
+  // 缓冲区已满时从最旧的一条开始显示
+  uint64_t count = (iringbuf_count < IRINGBUF_SIZE ? iringbuf_count : IRINGBUF_SIZE);
+  uint64_t start = iringbuf_count - count;
   
   // 打印指令缓冲区
-  for (int i = 0; i < count; i++) {
-    int idx = (start + i) % IRINGBUF_SIZE;
+  for (uint64_t i = start; i < iringbuf_count; i++) {
+    iringbuf_entry_t *e = &iringbuf[i & (IRINGBUF_SIZE - 1)];
+    char asm_buf[128] = "";
+    // 和 itrace 一样输出指令的各个字节，x86 按内存中的顺序，其余按指令字从高到低
+    char hex[IRINGBUF_INST_MAX * 3 + 1] = "", *p = hex;
+    if (e->len == 0) {
+      // 取指之前或执行过程中出错
+      strcpy(asm_buf, "(not completed)");
+    } else {
+      for (int j = 0; j < e->len; j ++) {
+        p += sprintf(p, " %02x", e->inst[MUXDEF(CONFIG_ISA_x86, j, e->len - 1 - j)]);
+      }
+#ifdef CONFIG_ITRACE
+      void disassemble(char *str, int size, uint64_t pc, uint8_t *code, int nbyte);
+      disassemble(asm_buf, sizeof(asm_buf), MUXDEF(CONFIG_ISA_x86, e->pc + e->len, e->pc),
+          e->inst, e->len);
+#endif
+    }
     
     // 在最后一条指令前添加箭头标记
-    const char *prefix = (i == count - 1) ? "--> " : "    ";
+    const char *prefix = (i == iringbuf_count - 1) ? "--> " : "    ";
     
-    printf("%s0x%08x: 0x%08x  %s\n", 
+    printf("%s" FMT_WORD ":%-*s  %s\n", 
            prefix, 
-           iringbuf[idx].pc, 
-           iringbuf[idx].inst, 
-           iringbuf[idx].asm_buf);
+           e->pc, 
+           MUXDEF(CONFIG_ISA_x86, 8, 4) * 3, hex, 
+           asm_buf);
   }
   
   printf("===================================\n");
-}
\ No newline at end of file
+}
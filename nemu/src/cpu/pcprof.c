@@ -0,0 +1,133 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <isa.h>
+#include <cpu/pcprof.h>
+#include <monitor/ftrace.h>
+
+#define NR_SLOT (CONFIG_MSIZE / 4)
+
+uint64_t *pcprof_count = NULL;
+uint64_t pcprof_other = 0;
+static const char *dump_file = NULL;
+
+typedef struct {
+  vaddr_t pc;
+  uint64_t count;
+} Hotspot;
+
+void init_pcprof(const char *file) {
+  // 只有被执行到的代码对应的页才会真正分配
+  pcprof_count = calloc(NR_SLOT, sizeof(pcprof_count[0]));
+  Assert(pcprof_count, "Can not allocate the pc profile counters");
+  dump_file = file;
+  atexit(pcprof_report);
+  Log("PC profiling is enabled, counters are dumped to %s", file);
+}
+
+// 在按次数从大到小排列的 top[] 中插入一项，只保留前 n 项
+static void top_insert(Hotspot *top, int n, int *nr, const Hotspot *h) {
+  if (*nr == n && top[n - 1].count >= h->count) return;
+  int i = (*nr < n ? (*nr) ++ : n - 1);
+  for (; i > 0 && top[i - 1].count < h->count; i --) top[i] = top[i - 1];
+  top[i] = *h;
+}
+
+static uint64_t *func_count = NULL;
+
+static uint64_t key_count(int f) { return func_count[f]; }
+
+static void report_functions(uint64_t total) {
+  int nr_func = func_nr();
+  if (nr_func == 0) {
+    printf("No symbols are loaded, use --elf to report hotspots by function\n");
+    return;
+  }
+  // 没有符号的指令不在这里累加，最后单独算出
+  func_count = calloc(nr_func + 1, sizeof(uint64_t));
+  assert(func_count);
+  uint64_t symbolized = 0;
+  for (int i = 0; i < nr_func; i ++) {
+    FuncInfo *fi = &ftrace_state.functions[i];
+    for (word_t pc = fi->addr; pc - fi->addr < fi->size; pc += 4) {
+      word_t idx = (pc - CONFIG_MBASE) >> 2;
+      if (idx < NR_SLOT) func_count[i] += pcprof_count[idx];
+    }
+    symbolized += func_count[i];
+  }
+
+  int order[CONFIG_PC_PROFILE_TOP];
+  int n = func_top(key_count, order, CONFIG_PC_PROFILE_TOP);
+  printf("Top functions:\n");
+  for (int i = 0; i < n && func_count[order[i]] > 0; i ++) {
+    int f = order[i];
+    printf("  %6.2f%%  %16" PRIu64 "  " FMT_WORD "  %s\n",
+        100.0 * func_count[f] / total, func_count[f], (word_t)ftrace_state.functions[f].addr, func_name(f));
+  }
+  // 符号表中函数大小可能重叠，这里只是粗略的估计
+  if (symbolized < total) {
+    printf("  %6.2f%%  %16" PRIu64 "  %10s  ???\n",
+        100.0 * (total - symbolized) / total, total - symbolized, "");
+  }
+  free(func_count);
+  func_count = NULL;
+}
+
+static void report_pcs(uint64_t total) {
+  Hotspot top[CONFIG_PC_PROFILE_TOP];
+  int nr = 0;
+  for (word_t i = 0; i < NR_SLOT; i ++) {
+    if (pcprof_count[i] == 0) continue;
+    Hotspot h = { .pc = CONFIG_MBASE + (i << 2), .count = pcprof_count[i] };
+    top_insert(top, CONFIG_PC_PROFILE_TOP, &nr, &h);
+  }
+  printf("Top instructions:\n");
+  for (int i = 0; i < nr; i ++) {
+    FuncInfo *fi = find_function(top[i].pc);
+    printf("  %6.2f%%  %16" PRIu64 "  " FMT_WORD "  ", 100.0 * top[i].count / total, top[i].count, top[i].pc);
+    if (fi != NULL) printf("%s+0x%x\n", fi->name, top[i].pc - fi->addr);
+    else printf("???\n");
+  }
+}
+
+static void dump_counts() {
+  FILE *fp = fopen(dump_file, "w");
+  if (fp == NULL) {
+    printf("Can not open '%s' to dump the pc profile\n", dump_file);
+    return;
+  }
+  for (word_t i = 0; i < NR_SLOT; i ++) {
+    if (pcprof_count[i] != 0) {
+      fprintf(fp, FMT_WORD " %" PRIu64 "\n", (word_t)(CONFIG_MBASE + (i << 2)), pcprof_count[i]);
+    }
+  }
+  fclose(fp);
+}
+
+// 程序结束或退出 NEMU 时输出报告，只输出一次
+void pcprof_report() {
+  if (pcprof_count == NULL) return;
+  uint64_t total = pcprof_other;
+  for (word_t i = 0; i < NR_SLOT; i ++) total += pcprof_count[i];
+  if (total > 0) {
+    Log("PC profile: %" PRIu64 " instructions profiled, %" PRIu64 " outside of pmem", total, pcprof_other);
+    report_functions(total);
+    report_pcs(total);
+  }
+  dump_counts();
+  free(pcprof_count);
+  pcprof_count = NULL;
+}
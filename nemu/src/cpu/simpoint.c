@@ -0,0 +1,128 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <isa.h>
+#include <cpu/decode.h>
+#include <cpu/simpoint.h>
+
+/* 基本块以入口地址区分，编号从 1 开始，按第一次执行的顺序分配。
+ * 每条指令都计入当前基本块，区间在恰好执行 interval 条指令时结束，
+ * 因此第 k 个区间从开始采样后的第 k * interval 条指令开始，
+ * 可以配合 --save-at 在区间起点保存快照。
+ */
+typedef struct {
+  vaddr_t pc;
+  uint64_t count;  // 当前区间内执行的指令数
+} BBInfo;
+
+static FILE *bbv_fp = NULL;
+static uint64_t interval = 0;
+static uint64_t interval_left = 0;
+static uint64_t nr_interval = 0;
+
+static BBInfo *bb = NULL;       // 下标 i 对应编号 i + 1 的基本块
+static uint32_t nr_bb = 0, bb_cap = 0;
+static uint32_t *bb_hash = NULL; // 开放寻址，保存 基本块下标 + 1，0 表示空位
+static uint32_t hash_cap = 0;
+static uint32_t *touched = NULL; // 当前区间执行过的基本块
+static uint32_t nr_touched = 0;
+
+static int64_t cur = -1;         // 正在执行的基本块，-1 表示下一条指令开始一个新的基本块
+
+static inline uint32_t hash_pc(vaddr_t pc, uint32_t cap) {
+  return ((uint32_t)(pc >> 2) * 2654435761u) & (cap - 1);
+}
+
+static void hash_insert(uint32_t idx) {
+  uint32_t h = hash_pc(bb[idx].pc, hash_cap);
+  while (bb_hash[h] != 0) h = (h + 1) & (hash_cap - 1);
+  bb_hash[h] = idx + 1;
+}
+
+static void hash_grow() {
+  free(bb_hash);
+  hash_cap = (hash_cap == 0 ? 4096 : hash_cap * 2);
+  bb_hash = calloc(hash_cap, sizeof(bb_hash[0]));
+  assert(bb_hash);
+  for (uint32_t i = 0; i < nr_bb; i ++) hash_insert(i);
+}
+
+static uint32_t bb_lookup(vaddr_t pc) {
+  uint32_t h = hash_pc(pc, hash_cap);
+  for (; bb_hash[h] != 0; h = (h + 1) & (hash_cap - 1)) {
+    uint32_t idx = bb_hash[h] - 1;
+    if (bb[idx].pc == pc) return idx;
+  }
+  // 第一次执行到的基本块
+  if (nr_bb == bb_cap) {
+    bb_cap = (bb_cap == 0 ? 4096 : bb_cap * 2);
+    bb = realloc(bb, sizeof(bb[0]) * bb_cap);
+    touched = realloc(touched, sizeof(touched[0]) * bb_cap);
+    assert(bb && touched);
+  }
+  uint32_t idx = nr_bb ++;
+  bb[idx] = (BBInfo) { .pc = pc, .count = 0 };
+  if (nr_bb * 2 > hash_cap) hash_grow();
+  else bb_hash[h] = idx + 1;
+  return idx;
+}
+
+static void emit_interval() {
+  if (nr_touched == 0) return;
+  fputc('T', bbv_fp);
+  for (uint32_t i = 0; i < nr_touched; i ++) {
+    BBInfo *b = &bb[touched[i]];
+    fprintf(bbv_fp, ":%u:%" PRIu64 " ", touched[i] + 1, b->count);
+    b->count = 0;
+  }
+  fputc('\n', bbv_fp);
+  nr_touched = 0;
+  nr_interval ++;
+}
+
+void init_simpoint(const char *file, uint64_t n) {
+  Assert(n > 0, "SimPoint interval must be positive");
+  bbv_fp = fopen(file, "w");
+  Assert(bbv_fp, "Can not open '%s'", file);
+  interval = interval_left = n;
+  hash_grow();
+  atexit(simpoint_finish);
+  Log("SimPoint BBV is written to %s, interval = %" PRIu64 " instructions", file, n);
+}
+
+bool simpoint_enabled() {
+  return bbv_fp != NULL;
+}
+
+void simpoint_exec(Decode *s) {
+  if (cur < 0) cur = bb_lookup(s->pc);
+  BBInfo *b = &bb[cur];
+  if (b->count ++ == 0) touched[nr_touched ++] = cur;
+  if (s->dnpc != s->snpc || isa_bb_end(s)) cur = -1;
+  if (-- interval_left == 0) {
+    emit_interval();
+    interval_left = interval;
+  }
+}
+
+// 输出最后一个不完整的区间
+void simpoint_finish() {
+  if (bbv_fp == NULL) return;
+  emit_interval();
+  fclose(bbv_fp);
+  bbv_fp = NULL;
+  Log("SimPoint: %" PRIu64 " intervals, %u basic blocks", nr_interval, nr_bb);
+}
@@ -0,0 +1,216 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <isa.h>
+#include <cpu/timing.h>
+#include <monitor/ftrace.h>
+#ifdef CONFIG_CACHE_SIM
+#include <cpu/cachesim.h>
+#endif
+#ifdef CONFIG_BPRED
+#include <cpu/bpred.h>
+#endif
+
+// 流水线填满之前的周期数
+#define PIPELINE_FILL 4
+
+// 延迟表，单位是周期，乘除法是占用 EX 的总周期数，其余是额外的停顿
+typedef struct {
+  const char *name;
+  int cycles;
+} Latency;
+
+enum { LAT_LOAD_USE, LAT_MUL, LAT_DIV, LAT_BRANCH, LAT_JUMP, LAT_SYSTEM,
+  LAT_L1I_MISS, LAT_L1D_MISS, LAT_L2_MISS, NR_LAT };
+
+static Latency lat[NR_LAT] = {
+  [LAT_LOAD_USE] = { "load_use", 1 }, [LAT_MUL] = { "mul", 3 }, [LAT_DIV] = { "div", 34 },
+  [LAT_BRANCH] = { "branch", 2 }, [LAT_JUMP] = { "jump", 1 }, [LAT_SYSTEM] = { "system", 3 },
+  [LAT_L1I_MISS] = { "l1i_miss", 10 }, [LAT_L1D_MISS] = { "l1d_miss", 10 }, [LAT_L2_MISS] = { "l2_miss", 50 },
+};
+
+// CPI 的组成部分
+enum { CPI_BASE, CPI_LOAD_USE, CPI_MULDIV, CPI_BRANCH, CPI_SYSTEM, CPI_ICACHE, CPI_DCACHE, CPI_L2, NR_CPI };
+static const char *cpi_name[NR_CPI] = {
+  "base", "load-use", "mul/div", "branch", "system", "icache", "dcache", "l2",
+};
+
+typedef struct {
+  uint64_t inst;
+  uint64_t cycles[NR_CPI];
+} TimingStat;
+
+bool timing_active = false;
+static bool configured = false;
+static TimingStat total = {};
+// 每个函数的统计，没有符号的地址记在最后一项
+static TimingStat *func_stat = NULL;
+static int nr_func = 0;
+static int last_load_rd = 0;
+#ifdef CONFIG_CACHE_SIM
+static uint64_t last_miss[NR_CACHE] = {};
+// 缓存模拟只在采样区间内进行，区间外的指令不计时，这里记下它们的条数
+static uint64_t nr_unsampled = 0;
+#endif
+
+/* 解析 --timing 选项：on 使用默认的延迟表，或者是逗号分隔的 NAME=CYCLES，
+ * NAME 是 load_use、mul、div、branch、jump、system、l1i_miss、l1d_miss 或 l2_miss
+ */
+bool timing_parse(const char *spec) {
+  configured = true;
+  if (strcmp(spec, "on") == 0) return true;
+  char buf[256];
+  snprintf(buf, sizeof(buf), "%s", spec);
+  for (char *t = strtok(buf, ","); t != NULL; t = strtok(NULL, ",")) {
+    char *eq = strchr(t, '=');
+    int i = NR_LAT;
+    if (eq != NULL) {
+      *eq = '\0';
+      for (i = 0; i < NR_LAT && strcmp(t, lat[i].name) != 0; i ++) ;
+    }
+    if (i == NR_LAT || atoi(eq + 1) < 0) {
+      printf("Invalid latency '%s' in '%s', the format is on or NAME=CYCLES,... where NAME is", t, spec);
+      for (i = 0; i < NR_LAT; i ++) printf(" %s", lat[i].name);
+      printf("\n");
+      return false;
+    }
+    lat[i].cycles = atoi(eq + 1);
+  }
+  return true;
+}
+
+void init_timing() {
+  if (!configured) return;
+  nr_func = func_nr();
+  func_stat = calloc(nr_func + 1, sizeof(TimingStat));
+  assert(func_stat);
+  total.cycles[CPI_BASE] = PIPELINE_FILL;
+  timing_active = true;
+  atexit(timing_report);
+  Log("Timing model: load-use %d, mul %d, div %d, branch %d, jump %d, system %d, "
+      "L1I miss %d, L1D miss %d, L2 miss %d cycles",
+      lat[LAT_LOAD_USE].cycles, lat[LAT_MUL].cycles, lat[LAT_DIV].cycles, lat[LAT_BRANCH].cycles,
+      lat[LAT_JUMP].cycles, lat[LAT_SYSTEM].cycles, lat[LAT_L1I_MISS].cycles,
+      lat[LAT_L1D_MISS].cycles, lat[LAT_L2_MISS].cycles);
+}
+
+/* 分支在 EX 级确定，jal 在 ID 级就知道目标。开启了分支预测器时只有预测错误才有代价，
+ * 否则按总是预测不跳转计算。
+ */
+static int branch_penalty(int cls, bool taken) {
+#ifdef CONFIG_BPRED
+  if (bpred_active) return (bpred_last_miss ? lat[LAT_BRANCH].cycles : 0);
+#endif
+  switch (cls) {
+    case T_BRANCH: return (taken ? lat[LAT_BRANCH].cycles : 0);
+    case T_JUMP: return lat[LAT_JUMP].cycles;
+    default: return lat[LAT_BRANCH].cycles;
+  }
+}
+
+void timing_inst(vaddr_t pc, int cls, int rd, int rs1, int rs2, bool taken) {
+#ifdef CONFIG_CACHE_SIM
+  if (cachesim_enabled() && !cachesim_active) {
+    nr_unsampled ++;
+    last_load_rd = 0;
+    return;
+  }
+#endif
+  uint64_t c[NR_CPI] = { [CPI_BASE] = 1 };
+  // load 的结果在 MEM 级末尾才能前递，紧跟着使用它的指令要停顿
+  if (last_load_rd != 0 && (rs1 == last_load_rd || rs2 == last_load_rd)) c[CPI_LOAD_USE] = lat[LAT_LOAD_USE].cycles;
+  last_load_rd = (cls == T_LOAD ? rd : 0);
+  switch (cls) {
+    // 乘除法部件不流水，占用 EX 级多个周期
+    case T_MUL: c[CPI_MULDIV] = (lat[LAT_MUL].cycles > 1 ? lat[LAT_MUL].cycles - 1 : 0); break;
+    case T_DIV: c[CPI_MULDIV] = (lat[LAT_DIV].cycles > 1 ? lat[LAT_DIV].cycles - 1 : 0); break;
+    case T_BRANCH: case T_JUMP: case T_JUMP_IND: c[CPI_BRANCH] = branch_penalty(cls, taken); break;
+    case T_SYSTEM: c[CPI_SYSTEM] = lat[LAT_SYSTEM].cycles; break;
+  }
+#ifdef CONFIG_CACHE_SIM
+  // 这条指令的取指和访存在它之前已经送进了缓存模拟器
+  static const int miss_cpi[NR_CACHE] = { [CACHE_L1I] = CPI_ICACHE, [CACHE_L1D] = CPI_DCACHE, [CACHE_L2] = CPI_L2 };
+  static const int miss_lat[NR_CACHE] = { [CACHE_L1I] = LAT_L1I_MISS, [CACHE_L1D] = LAT_L1D_MISS, [CACHE_L2] = LAT_L2_MISS };
+  for (int i = 0; i < NR_CACHE; i ++) {
+    uint64_t miss = cachesim_misses(i);
+    c[miss_cpi[i]] = (miss - last_miss[i]) * lat[miss_lat[i]].cycles;
+    last_miss[i] = miss;
+  }
+#endif
+  TimingStat *fs = &func_stat[func_index(find_function(pc))];
+  total.inst ++;
+  fs->inst ++;
+  for (int i = 0; i < NR_CPI; i ++) {
+    total.cycles[i] += c[i];
+    fs->cycles[i] += c[i];
+  }
+}
+
+static uint64_t sum_cycles(const TimingStat *t) {
+  uint64_t sum = 0;
+  for (int i = 0; i < NR_CPI; i ++) sum += t->cycles[i];
+  return sum;
+}
+
+static uint64_t key_cycles(int f) { return sum_cycles(&func_stat[f]); }
+
+static void print_breakdown(const TimingStat *t) {
+  for (int i = 0; i < NR_CPI; i ++) printf("  %8.3f", (t->inst ? (double)t->cycles[i] / t->inst : 0.0));
+}
+
+static void report_functions() {
+  if (nr_func == 0) {
+    printf("No symbols are loaded, use --elf to report CPI by function\n");
+    return;
+  }
+  int order[CONFIG_TIMING_TOP];
+  int n = func_top(key_cycles, order, CONFIG_TIMING_TOP);
+  printf("CPI by function:\n");
+  printf("  %16s  %14s  %8s", "cycles", "instructions", "CPI");
+  for (int i = 0; i < NR_CPI; i ++) printf("  %8s", cpi_name[i]);
+  printf("  function\n");
+  for (int i = 0; i < n; i ++) {
+    TimingStat *t = &func_stat[order[i]];
+    if (t->inst == 0) break;
+    uint64_t cycles = sum_cycles(t);
+    printf("  %16" PRIu64 "  %14" PRIu64 "  %8.3f", cycles, t->inst, (double)cycles / t->inst);
+    print_breakdown(t);
+    printf("  %s\n", func_name(order[i]));
+  }
+}
+
+void timing_report() {
+  if (!timing_active) return;
+  timing_active = false;
+  uint64_t cycles = sum_cycles(&total);
+  if (total.inst > 0) {
+    Log("Timing model: %" PRIu64 " instructions, %" PRIu64 " cycles, IPC = %.3f, CPI = %.3f",
+        total.inst, cycles, (double)total.inst / cycles, (double)cycles / total.inst);
+    printf("CPI breakdown:");
+    for (int i = 0; i < NR_CPI; i ++) printf("  %s %.3f", cpi_name[i], (double)total.cycles[i] / total.inst);
+    printf("\n");
+    IFNDEF(CONFIG_CACHE_SIM, printf("Caches are not simulated, memory accesses are assumed to hit\n"));
+#ifdef CONFIG_CACHE_SIM
+    if (nr_unsampled > 0) {
+      printf("Only the %" PRIu64 " instructions in the cache simulation samples are timed, "
+          "%" PRIu64 " outside them are not\n", total.inst, nr_unsampled);
+    }
+#endif
+    report_functions();
+  }
+  free(func_stat);
+  func_stat = NULL;
+}
@@ -33,10 +33,44 @@ void init_alarm();
 void send_key(uint8_t, bool);
 void vga_update_screen();
 
+/* cpu_exec 每执行 device_quantum 条指令才调用一次 device_update()。
+ * 这里根据两次调用之间实际经过的时间调整它，使每个 1/TIMER_HZ 周期内
+ * 大约检查 DEVICE_CHECKS_PER_TICK 次：既不会错过 60Hz 的屏幕刷新和按键，
+ * 也不必在每条指令之后都读取宿主时钟。
+ */
+#define DEVICE_CHECKS_PER_TICK 4
+#define DEVICE_QUANTUM_MIN 64
+#define DEVICE_QUANTUM_MAX (1ull << 24)
+
+uint64_t device_quantum = CONFIG_DEVICE_QUANTUM;
+static uint64_t last_check = 0;
+
+/* 只有这次检查确实有设备要处理(到了刷新的时刻)时才缩小，否则只可能放大。
+ * 每次最多变化一倍，偶然的一次慢速检查不会把它调得过小。
+ */
+static void adjust_quantum(uint64_t elapsed, bool pending) {
+  const uint64_t target = 1000000 / TIMER_HZ / DEVICE_CHECKS_PER_TICK;
+  uint64_t q = (elapsed == 0 ? device_quantum * 2 : device_quantum * target / elapsed);
+  if (q < device_quantum && !pending) q = device_quantum;
+  if (q < device_quantum / 2) q = device_quantum / 2;
+  if (q > device_quantum * 2) q = device_quantum * 2;
+  if (q < DEVICE_QUANTUM_MIN) q = DEVICE_QUANTUM_MIN;
+  if (q > DEVICE_QUANTUM_MAX) q = DEVICE_QUANTUM_MAX;
+  device_quantum = q;
+}
+
+// 由 cpu_exec() 在开始执行时调用，在 sdb 中暂停的时间不计入两次检查的间隔
+void device_resume() {
+  last_check = get_time();
+}
+
 void device_update() {
   static uint64_t last = 0;
   uint64_t now = get_time();
-  if (now - last < 1000000 / TIMER_HZ) {
+  bool pending = (now - last >= 1000000 / TIMER_HZ);
+  adjust_quantum(now - last_check, pending);
+  last_check = now;
+  if (!pending) {
     return;
   }
   last = now;
@@ -17,6 +17,9 @@
 #include <memory/host.h>
 #include <memory/vaddr.h>
 #include <device/map.h>
+#ifdef CONFIG_SNAPSHOT
+#include <monitor/snapshot.h>
+#endif
 
 #define IO_SPACE_MAX (32 * 1024 * 1024)
 
@@ -52,6 +55,21 @@ void init_map() {
   p_space = io_space;
 }
 
+#ifdef CONFIG_SNAPSHOT
+// 设备寄存器和显存都在io_space中, 只需保存已分配的部分
+void map_snapshot(Snapshot *ss) {
+  uint32_t size = p_space - io_space;
+  uint32_t saved = size;
+  snapshot_data(ss, &saved, sizeof(saved));
+  if (!ss->is_save && ss->ok && saved != size) {
+    Log("snapshot: io space size mismatch (%u != %u)", saved, size);
+    ss->ok = false;
+    return;
+  }
+  snapshot_data(ss, io_space, size);
+}
+#endif
+
 word_t map_read(paddr_t addr, int len, IOMap *map) {
   assert(len >= 1 && len <= 8);
   check_bound(map, addr);
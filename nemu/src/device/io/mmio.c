@@ -15,25 +15,68 @@
 
 #include <device/map.h>
 #include <memory/paddr.h>
+#include <device/mmio.h>
 
 #define NR_MAP 16
 
+/* 每个物理页对应的映射：0 表示没有映射，MMIO_PAGE_SHARED 表示页中
+ * 有多个映射，需要逐个查找，其余为映射的下标加一
+ */
+#define MMIO_NR_PAGE (1ull << (32 - PAGE_SHIFT))
+#define MMIO_PAGE_SHARED 0xff
+
 static IOMap maps[NR_MAP] = {};
 static int nr_map = 0;
+#ifdef CONFIG_INST_STAT
+#include <cpu/inststat.h>
+
+static MemStat map_stat[NR_MAP] = {};
+
+MemStat* mmio_stat(int i, const char **name) {
+  if (i >= nr_map) return NULL;
+  *name = maps[i].name;
+  return &map_stat[i];
+}
+#endif
+static uint8_t mmio_page[MMIO_NR_PAGE] = {};
+
+static inline int mmio_page_id(paddr_t addr) {
+  uint64_t page = (uint64_t)addr >> PAGE_SHIFT;
+  return (page < MMIO_NR_PAGE ? mmio_page[page] : MMIO_PAGE_SHARED);
+}
 
 static IOMap* fetch_mmio_map(paddr_t addr) {
+  int id = mmio_page_id(addr);
+  if (likely(id != MMIO_PAGE_SHARED)) {
+    if (id == 0 || !map_inside(&maps[id - 1], addr)) return NULL;
+    difftest_skip_ref();
+    return &maps[id - 1];
+  }
   int mapid = find_mapid_by_addr(maps, nr_map, addr);
   return (mapid == -1 ? NULL : &maps[mapid]);
 }
 
+/* 如果 page 所在的整个物理页都属于一个用 add_mmio_map_direct() 映射的区域，
+ * 返回它在宿主中的地址，软件 TLB 可以像访问内存一样直接访问它；否则返回 NULL
+ */
+uint8_t* mmio_page_host(paddr_t page) {
+  // DiffTest 需要在每次访问设备时让 REF 跳过，访存统计要看到每一次设备访问
+  if (ISDEF(CONFIG_DIFFTEST) || ISDEF(CONFIG_INST_STAT)) return NULL;
+  int id = mmio_page_id(page);
+  if (id == 0 || id == MMIO_PAGE_SHARED) return NULL;
+  IOMap *map = &maps[id - 1];
+  if (!map->direct || page < map->low || page + PAGE_SIZE - 1 > map->high) return NULL;
+  return (uint8_t *)map->space + (page - map->low);
+}
+
 static void report_mmio_overlap(const char *name1, paddr_t l1, paddr_t r1,
     const char *name2, paddr_t l2, paddr_t r2) {
   panic("MMIO region %s@[" FMT_PADDR ", " FMT_PADDR "] is overlapped "
                "with %s@[" FMT_PADDR ", " FMT_PADDR "]", name1, l1, r1, name2, l2, r2);
 }
 
-/* device interface */
-void add_mmio_map(const char *name, paddr_t addr, void *space, uint32_t len, io_callback_t callback) {
+static void new_mmio_map(const char *name, paddr_t addr, void *space, uint32_t len,
+    io_callback_t callback, bool direct) {
   assert(nr_map < NR_MAP);
   paddr_t left = addr, right = addr + len - 1;
   if (in_pmem(left) || in_pmem(right)) {
@@ -45,19 +88,36 @@ void add_mmio_map(const char *name, paddr_t addr, void *space, uint32_t len, io_
     }
   }
 
+  for (uint64_t p = left >> PAGE_SHIFT; p <= (right >> PAGE_SHIFT) && p < MMIO_NR_PAGE; p ++) {
+    mmio_page[p] = (mmio_page[p] == 0 ? nr_map + 1 : MMIO_PAGE_SHARED);
+  }
+
   maps[nr_map] = (IOMap){ .name = name, .low = addr, .high = addr + len - 1,
-    .space = space, .callback = callback };
+    .space = space, .callback = callback, .direct = direct };
   Log("Add mmio map '%s' at [" FMT_PADDR ", " FMT_PADDR "]",
       maps[nr_map].name, maps[nr_map].low, maps[nr_map].high);
 
   nr_map ++;
 }
 
+/* device interface */
+void add_mmio_map(const char *name, paddr_t addr, void *space, uint32_t len, io_callback_t callback) {
+  new_mmio_map(name, addr, space, len, callback, false);
+}
+
+void add_mmio_map_direct(const char *name, paddr_t addr, void *space, uint32_t len) {
+  new_mmio_map(name, addr, space, len, NULL, true);
+}
+
 /* bus interface */
 word_t mmio_read(paddr_t addr, int len) {
-  return map_read(addr, len, fetch_mmio_map(addr));
+  IOMap *map = fetch_mmio_map(addr);
+  IFDEF(CONFIG_INST_STAT, if (map != NULL) mem_stat_add(&map_stat[map - maps], len, false));
+  return map_read(addr, len, map);
 }
 
 void mmio_write(paddr_t addr, int len, word_t data) {
-  map_write(addr, len, data, fetch_mmio_map(addr));
+  IOMap *map = fetch_mmio_map(addr);
+  IFDEF(CONFIG_INST_STAT, if (map != NULL) mem_stat_add(&map_stat[map - maps], len, true));
+  map_write(addr, len, data, map);
 }
@@ -15,6 +15,9 @@
 
 #include <device/map.h>
 #include <utils.h>
+#ifdef CONFIG_SNAPSHOT
+#include <monitor/snapshot.h>
+#endif
 
 #define KEYDOWN_MASK 0x8000
 
@@ -70,6 +73,14 @@ void send_key(uint8_t scancode, bool is_keydown) {
     key_enqueue(am_scancode);
   }
 }
+
+#ifdef CONFIG_SNAPSHOT
+void keyboard_snapshot(Snapshot *ss) {
+  snapshot_data(ss, key_queue, sizeof(key_queue));
+  snapshot_data(ss, &key_f, sizeof(key_f));
+  snapshot_data(ss, &key_r, sizeof(key_r));
+}
+#endif
 #else // !CONFIG_TARGET_AM
 #define NEMU_KEY_NONE 0
 
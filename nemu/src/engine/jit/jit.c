@@ -0,0 +1,482 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+/* 把热的基本块翻译成 x86-64 代码。
+ * 每个块被编译成一个函数 int block()：执行块内的指令，把下一条指令的地址写到
+ * cpu.pc，返回执行的指令数。块内用到最多的几个 guest 寄存器放在宿主寄存器中，
+ * 只在块的入口读入、出口写回；访存先内联检查是否落在 pmem 中，是则直接访问宿主内存，
+ * 否则调用 vaddr_read/vaddr_write 走设备。块只在出口返回，因此设备和中断的处理不受影响。
+ */
+
+#if !defined(__x86_64__)
+#error "the JIT only supports x86-64 hosts"
+#endif
+
+#include <isa.h>
+#include <cpu/cpu.h>
+#include <cpu/decode.h>
+#include <cpu/tb.h>
+#include <cpu/iringbuf.h>
+#include <memory/host.h>
+#include <memory/paddr.h>
+#include <memory/vaddr.h>
+#include <monitor/ftrace.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "x86.h"
+
+// 块执行多少次后编译
+#define JIT_HOT_THRESHOLD 16
+#define JIT_CACHE_SIZE (16 * 1024 * 1024)
+// 一个块编译后的最大长度(粗略上界)，代码缓存剩余空间不足时全部作废
+#define JIT_MAX_BLOCK_SIZE (TB_MAX_INST * 512 + 256)
+
+#define NR_GPR ARRLEN(cpu.gpr)
+#define GPR_OFF(i) ((int32_t)offsetof(CPU_state, gpr[i]))
+#define PC_OFF ((int32_t)offsetof(CPU_state, pc))
+
+typedef int (*jit_block_t)();
+
+uint8_t *x86_p = NULL;
+static uint8_t *code_cache = NULL;
+static bool jit_disabled = false;
+// 每个 pmem 字一位，记录它是否被编译过
+static uint8_t *jit_word_map = NULL;
+// 每次作废全部本机代码时加一，让正在执行的块知道自己已经失效
+static uint64_t jit_gen = 0;
+#ifdef CONFIG_JIT_PERF_MAP
+static FILE *perf_map = NULL;
+#endif
+
+/* 用于缓存 guest 寄存器的宿主寄存器。r15 指向 cpu，r14 指向 pmem，
+ * rax/rcx/rdx 用作临时寄存器；调用 C 函数前后要保存其中调用者保存的部分。
+ */
+static const int cache_regs[] = { RBX, RBP, R12, R13, RSI, RDI, R8, R9, R10, R11 };
+static const int caller_saved[] = { RSI, RDI, R8, R9, R10, R11 };
+static const int callee_saved[] = { RBX, RBP, R12, R13, R14, R15 };
+
+static int host_reg[32];    // guest 寄存器对应的宿主寄存器，-1 表示在内存中
+static bool written[32];    // 块内被写过的 guest 寄存器，出口处要写回
+// 编译时是否有数据监视点，设置或删除数据监视点时本机代码会全部作废
+static bool jit_watch = false;
+
+/* ---------- 辅助函数，由编译出的代码调用 ---------- */
+
+static word_t jit_load(vaddr_t addr, int len) {
+  return vaddr_read(addr, len);
+}
+
+static void jit_store(vaddr_t addr, int len, word_t data) {
+  vaddr_write(addr, len, data);
+}
+
+// 写了曾执行过的代码页，返回非 0 表示本机代码已全部作废，块要立即退出
+static int jit_code_page_write(paddr_t addr, int len) {
+  uint64_t gen = jit_gen;
+  pmem_code_write(addr, len);
+  return jit_gen != gen;
+}
+
+/* ---------- 代码生成 ---------- */
+
+static void load_gpr(int dst, int r) {
+  if (r == 0) x86_alu_rr(ALU_XOR, dst, dst);
+  else if (host_reg[r] >= 0) x86_alu_rr(ALU_MOV, dst, host_reg[r]);
+  else x86_load(dst, R15, GPR_OFF(r));
+}
+
+static void store_gpr(int r, int src) {
+  if (r == 0) return;
+  if (host_reg[r] >= 0) x86_alu_rr(ALU_MOV, host_reg[r], src);
+  else x86_store(R15, GPR_OFF(r), src);
+}
+
+// 调用 fn(eax, len, edx)，返回值在 eax 中
+static void emit_call(const void *fn, int len) {
+  for (int i = 0; i < ARRLEN(caller_saved); i ++) x86_push(caller_saved[i]);
+  x86_alu_rr(ALU_MOV, RDI, RAX);
+  x86_mov_ri(RSI, len);
+  x86_call(fn);
+  for (int i = ARRLEN(caller_saved) - 1; i >= 0; i --) x86_pop(caller_saved[i]);
+}
+
+static void emit_prologue() {
+  for (int i = 0; i < ARRLEN(callee_saved); i ++) x86_push(callee_saved[i]);
+  x86_push(RAX);  // 保持调用 C 函数时栈 16 字节对齐
+  x86_movabs(R15, (uintptr_t)&cpu);
+  x86_movabs(R14, (uintptr_t)guest_to_host(CONFIG_MBASE));
+  for (int r = 1; r < 32; r ++) {
+    if (host_reg[r] >= 0) x86_load(host_reg[r], R15, GPR_OFF(r));
+  }
+}
+
+// 写回寄存器并返回；npc_reg < 0 时下一条指令的地址是常数 npc
+static void emit_exit(vaddr_t npc, int npc_reg, int nr_inst) {
+  for (int r = 1; r < 32; r ++) {
+    if (host_reg[r] >= 0 && written[r]) x86_store(R15, GPR_OFF(r), host_reg[r]);
+  }
+  if (npc_reg >= 0) x86_store(R15, PC_OFF, npc_reg);
+  else x86_store_imm(R15, PC_OFF, npc);
+  x86_mov_ri(RAX, nr_inst);
+  x86_pop(RCX);
+  for (int i = ARRLEN(callee_saved) - 1; i >= 0; i --) x86_pop(callee_saved[i]);
+  x86_ret();
+}
+
+/* eax = rs1 + imm，ecx = eax 在 pmem 中的偏移。不在 pmem 中，或者 [eax, eax + len)
+ * 碰到有数据监视点的页时跳到慢速路径，要回填的跳转记在 slow 中，返回其个数。
+ */
+static int emit_pmem_check(int rs1, word_t imm, int len, uint8_t **slow) {
+  int n = 0;
+  load_gpr(RAX, rs1);
+  if (imm != 0) x86_alu_ri(EXT_ADD, RAX, imm);
+  x86_alu_rr(ALU_MOV, RCX, RAX);
+  x86_alu_ri(EXT_SUB, RCX, CONFIG_MBASE);
+  x86_alu_ri(EXT_CMP, RCX, CONFIG_MSIZE);
+  slow[n ++] = x86_jcc(CC_AE);
+#ifdef CONFIG_WATCHPOINT
+  if (jit_watch) {
+    x86_movabs(RDX, (uintptr_t)pmem_watch_page);
+    for (int k = 0; k < (len > 1 ? 2 : 1); k ++) {
+      x86_push(RCX);
+      if (k == 1) x86_alu_ri(EXT_ADD, RCX, len - 1);
+      x86_shift_ri(SHIFT_SHR, RCX, PAGE_SHIFT, false);
+      x86_cmpb_idx(RDX, RCX, 0);
+      x86_pop(RCX);
+      slow[n ++] = x86_jcc(CC_NE);
+    }
+  }
+#endif
+  return n;
+}
+
+// 数据监视点命中时报告 cpu.pc，块内的 cpu.pc 平时不更新，走慢速路径前写入当前指令的地址
+static void emit_watch_pc(vaddr_t pc) {
+  if (jit_watch) x86_store_imm(R15, PC_OFF, pc);
+}
+
+// 慢速路径上命中了数据监视点时 nemu_state 不再是 NEMU_RUNNING，要在这条指令之后退出
+static void emit_stop_check(vaddr_t npc, int nr_inst) {
+  if (!jit_watch) return;
+  x86_movabs(RDX, (uintptr_t)&nemu_state.state);
+  x86_load(RDX, RDX, 0);
+  x86_alu_ri(EXT_CMP, RDX, NEMU_RUNNING);
+  uint8_t *running = x86_jcc(CC_E);
+  emit_exit(npc, -1, nr_inst);
+  x86_patch(running);
+}
+
+static void emit_load(int rd, int rs1, word_t imm, int len, bool sext, vaddr_t npc, int nr_inst) {
+  uint8_t *slow[3];
+  int nr_slow = emit_pmem_check(rs1, imm, len, slow);
+  x86_load_idx(RAX, R14, RCX, len);
+  uint8_t *done = x86_jmp();
+  for (int k = 0; k < nr_slow; k ++) x86_patch(slow[k]);
+  emit_watch_pc(npc - 4);
+  emit_call((const void *)jit_load, len);
+  x86_patch(done);
+  if (sext) x86_sext_eax(len);
+  store_gpr(rd, RAX);
+  emit_stop_check(npc, nr_inst);
+}
+
+static void emit_store(int rs1, int rs2, word_t imm, int len, vaddr_t npc, int nr_inst) {
+  uint8_t *slow[3];
+  int nr_slow = emit_pmem_check(rs1, imm, len, slow);
+  load_gpr(RDX, rs2);
+  x86_store_idx(R14, RCX, RDX, len);
+  // 写到了曾执行过的代码页时要作废缓存，没有对齐的写可能跨到下一页，两页都要检查
+  x86_shift_ri(SHIFT_SHR, RCX, PAGE_SHIFT, false);
+  x86_movabs(RDX, (uintptr_t)pmem_code_page);
+  x86_cmpb_idx(RDX, RCX, 0);
+  uint8_t *done;
+  if (len > 1) {
+    uint8_t *hit = x86_jcc(CC_NE);
+    x86_alu_rr(ALU_MOV, RCX, RAX);
+    x86_alu_ri(EXT_SUB, RCX, CONFIG_MBASE - (len - 1));
+    x86_shift_ri(SHIFT_SHR, RCX, PAGE_SHIFT, false);
+    x86_cmpb_idx(RDX, RCX, 0);
+    done = x86_jcc(CC_E);
+    x86_patch(hit);
+  } else {
+    done = x86_jcc(CC_E);
+  }
+  emit_call((const void *)jit_code_page_write, len);
+  x86_alu_rr(ALU_TEST, RAX, RAX);
+  uint8_t *done2 = x86_jcc(CC_E);
+  emit_exit(npc, -1, nr_inst);
+  for (int k = 0; k < nr_slow; k ++) x86_patch(slow[k]);
+  emit_watch_pc(npc - 4);
+  load_gpr(RDX, rs2);
+  emit_call((const void *)jit_store, len);
+  x86_patch(done);
+  x86_patch(done2);
+  emit_stop_check(npc, nr_inst);
+}
+
+static void emit_op_imm(uint32_t i, int rd, int rs1, word_t imm) {
+  load_gpr(RAX, rs1);
+  switch (BITS(i, 14, 12)) {
+    case 0: x86_alu_ri(EXT_ADD, RAX, imm); break;
+    case 2: x86_alu_ri(EXT_CMP, RAX, imm); x86_setcc_eax(CC_L); break;
+    case 3: x86_alu_ri(EXT_CMP, RAX, imm); x86_setcc_eax(CC_B); break;
+    case 4: x86_alu_ri(EXT_XOR, RAX, imm); break;
+    case 6: x86_alu_ri(EXT_OR,  RAX, imm); break;
+    case 7: x86_alu_ri(EXT_AND, RAX, imm); break;
+    case 1: x86_shift_ri(SHIFT_SHL, RAX, imm & 0x1f, false); break;
+    case 5: x86_shift_ri(BITS(i, 30, 30) ? SHIFT_SAR : SHIFT_SHR, RAX, imm & 0x1f, false); break;
+  }
+  store_gpr(rd, RAX);
+}
+
+static void emit_op(uint32_t i, int rd, int rs1, int rs2) {
+  load_gpr(RAX, rs1);
+  load_gpr(RCX, rs2);
+  int f3 = BITS(i, 14, 12);
+  if (BITS(i, 31, 25) == 1) {
+    switch (f3) {
+      case 0: x86_imul_rr(RAX, RCX, false); break;
+      case 1: x86_movsxd(RAX, RAX); x86_movsxd(RCX, RCX);
+              x86_imul_rr(RAX, RCX, true); x86_shift_ri(SHIFT_SHR, RAX, 32, true); break;
+      case 2: x86_movsxd(RAX, RAX);
+              x86_imul_rr(RAX, RCX, true); x86_shift_ri(SHIFT_SHR, RAX, 32, true); break;
+      case 3: x86_muldiv(4, RCX); x86_alu_rr(ALU_MOV, RAX, RDX); break;
+      // 和解释器一样直接使用宿主的除法指令
+      case 4: case 6: x86_cdq(); x86_muldiv(7, RCX); break;
+      case 5: case 7: x86_alu_rr(ALU_XOR, RDX, RDX); x86_muldiv(6, RCX); break;
+    }
+    if (f3 == 6 || f3 == 7) x86_alu_rr(ALU_MOV, RAX, RDX);
+  } else {
+    bool alt = BITS(i, 30, 30);
+    switch (f3) {
+      case 0: x86_alu_rr(alt ? ALU_SUB : ALU_ADD, RAX, RCX); break;
+      case 1: x86_shift_rcl(SHIFT_SHL, RAX); break;
+      case 2: x86_alu_rr(ALU_CMP, RAX, RCX); x86_setcc_eax(CC_L); break;
+      case 3: x86_alu_rr(ALU_CMP, RAX, RCX); x86_setcc_eax(CC_B); break;
+      case 4: x86_alu_rr(ALU_XOR, RAX, RCX); break;
+      case 5: x86_shift_rcl(alt ? SHIFT_SAR : SHIFT_SHR, RAX); break;
+      case 6: x86_alu_rr(ALU_OR,  RAX, RCX); break;
+      case 7: x86_alu_rr(ALU_AND, RAX, RCX); break;
+    }
+  }
+  store_gpr(rd, RAX);
+}
+
+static void emit_branch(uint32_t i, int rs1, int rs2, vaddr_t pc, word_t imm, int nr_inst) {
+  static const int cc[8] = { CC_E, CC_NE, -1, -1, CC_L, CC_GE, CC_B, CC_AE };
+  load_gpr(RAX, rs1);
+  load_gpr(RCX, rs2);
+  x86_alu_rr(ALU_CMP, RAX, RCX);
+  uint8_t *taken = x86_jcc(cc[BITS(i, 14, 12)]);
+  emit_exit(pc + 4, -1, nr_inst);
+  x86_patch(taken);
+  emit_exit(pc + imm, -1, nr_inst);
+}
+
+/* ---------- 翻译 ---------- */
+
+// 能否翻译这条指令；要求和解释器中 INSTPAT 的匹配结果完全一致
+static bool jit_can_translate(uint32_t i) {
+  int f3 = BITS(i, 14, 12), f7 = BITS(i, 31, 25);
+  if (BITS(i, 11, 7) >= NR_GPR || BITS(i, 19, 15) >= NR_GPR || BITS(i, 24, 20) >= NR_GPR) return false;
+  switch (BITS(i, 6, 0)) {
+    case 0x37: case 0x17: return true;
+    case 0x13: return (f3 == 1 ? f7 == 0 : f3 == 5 ? (f7 == 0 || f7 == 0x20) : true);
+    case 0x33: return (f7 == 0 || f7 == 1 || (f7 == 0x20 && (f3 == 0 || f3 == 5)));
+    case 0x03: return (f3 == 0 || f3 == 1 || f3 == 2 || f3 == 4 || f3 == 5);
+    case 0x23: return (f3 <= 2);
+    case 0x63: return (f3 != 2 && f3 != 3);
+    // jal/jalr 要调用 ftrace，开启 ftrace 时交给解释器
+    case 0x6f: return !ftrace_state.enabled;
+    case 0x67: return (f3 == 0 && !ftrace_state.enabled);
+    default: return false;
+  }
+}
+
+static void count_regs(uint32_t i, int *nr_use) {
+  int op = BITS(i, 6, 0);
+  bool has_rd = (op != 0x23 && op != 0x63);
+  bool has_rs1 = (op != 0x37 && op != 0x17 && op != 0x6f);
+  bool has_rs2 = (op == 0x33 || op == 0x23 || op == 0x63);
+  if (has_rd)  { nr_use[BITS(i, 11, 7)] ++; written[BITS(i, 11, 7)] = true; }
+  if (has_rs1) nr_use[BITS(i, 19, 15)] ++;
+  if (has_rs2) nr_use[BITS(i, 24, 20)] ++;
+}
+
+// 把使用次数最多的 guest 寄存器分配到宿主寄存器中
+static void alloc_regs(const int *nr_use) {
+  bool used[32] = {};
+  for (int r = 0; r < 32; r ++) host_reg[r] = -1;
+  for (int k = 0; k < ARRLEN(cache_regs); k ++) {
+    int best = 0;
+    for (int r = 1; r < 32; r ++) {
+      if (!used[r] && nr_use[r] > nr_use[best]) best = r;
+    }
+    if (best == 0) break;
+    used[best] = true;
+    host_reg[best] = cache_regs[k];
+  }
+}
+
+static void translate(uint32_t i, vaddr_t pc, int nr_inst) {
+  int rd = BITS(i, 11, 7), rs1 = BITS(i, 19, 15), rs2 = BITS(i, 24, 20);
+  word_t immI = SEXT(BITS(i, 31, 20), 12);
+  switch (BITS(i, 6, 0)) {
+    case 0x37: x86_mov_ri(RAX, BITS(i, 31, 12) << 12); store_gpr(rd, RAX); break;
+    case 0x17: x86_mov_ri(RAX, pc + (BITS(i, 31, 12) << 12)); store_gpr(rd, RAX); break;
+    case 0x13: emit_op_imm(i, rd, rs1, immI); break;
+    case 0x33: emit_op(i, rd, rs1, rs2); break;
+    case 0x03: {
+      int f3 = BITS(i, 14, 12);
+      emit_load(rd, rs1, immI, 1 << (f3 & 3), f3 < 2, pc + 4, nr_inst);
+      break;
+    }
+    case 0x23: {
+      word_t imm = (SEXT(BITS(i, 31, 25), 7) << 5) | BITS(i, 11, 7);
+      emit_store(rs1, rs2, imm, 1 << BITS(i, 14, 12), pc + 4, nr_inst);
+      break;
+    }
+    case 0x63: {
+      word_t imm = SEXT(BITS(i, 31, 31), 1) << 12 | BITS(i, 7, 7) << 11 |
+        BITS(i, 30, 25) << 5 | BITS(i, 11, 8) << 1;
+      emit_branch(i, rs1, rs2, pc, imm, nr_inst);
+      break;
+    }
+    case 0x6f: {
+      word_t imm = SEXT(BITS(i, 31, 31), 1) << 20 | BITS(i, 19, 12) << 12 |
+        BITS(i, 20, 20) << 11 | BITS(i, 30, 21) << 1;
+      x86_mov_ri(RAX, pc + 4);
+      store_gpr(rd, RAX);
+      emit_exit(pc + imm, -1, nr_inst);
+      break;
+    }
+    case 0x67:
+      load_gpr(RDX, rs1);
+      if (immI != 0) x86_alu_ri(EXT_ADD, RDX, immI);
+      x86_alu_ri(EXT_AND, RDX, ~1u);
+      x86_mov_ri(RAX, pc + 4);
+      store_gpr(rd, RAX);
+      emit_exit(0, RDX, nr_inst);
+      break;
+    default: panic("unsupported instruction " FMT_WORD " at pc = " FMT_WORD, i, pc);
+  }
+}
+
+static bool jit_init() {
+  code_cache = mmap(NULL, JIT_CACHE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (code_cache == MAP_FAILED) {
+    Log("JIT disabled: can not allocate executable memory");
+    jit_disabled = true;
+    return false;
+  }
+  x86_p = code_cache;
+  jit_word_map = calloc(CONFIG_MSIZE / 4 / 8, 1);
+  assert(jit_word_map);
+#ifdef CONFIG_JIT_PERF_MAP
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/perf-%d.map", getpid());
+  perf_map = fopen(path, "w");
+#endif
+  return true;
+}
+
+void jit_flush() {
+  if (code_cache == NULL) return;
+  x86_p = code_cache;
+  memset(jit_word_map, 0, CONFIG_MSIZE / 4 / 8);
+  pmem_unmark_code_all(PMEM_CODE_JIT);
+  jit_gen ++;
+  tb_flush();
+}
+
+void jit_code_write(paddr_t addr, int len) {
+  if (jit_word_map == NULL) return;
+  paddr_t end = (addr + len - 1) & ~(paddr_t)0x3;
+  for (paddr_t a = addr & ~(paddr_t)0x3; a <= end; a += 4) {
+    paddr_t w = (a - CONFIG_MBASE) >> 2;
+    if (in_pmem(a) && (jit_word_map[w >> 3] & (1 << (w & 7)))) {
+      jit_flush();
+      return;
+    }
+  }
+}
+
+static void jit_compile(TBlock *tb) {
+  if (code_cache == NULL && !jit_init()) return;
+  if (x86_p + JIT_MAX_BLOCK_SIZE > code_cache + JIT_CACHE_SIZE) jit_flush();
+  if (tb->nr_inst == 0 || !in_pmem(tb->pc)) return;
+
+  uint32_t inst[TB_MAX_INST];
+  int nr_use[32] = {}, n = 0;
+  memset(written, 0, sizeof(written));
+  IFDEF(CONFIG_WATCHPOINT, jit_watch = pmem_watch_any());
+  for (; n < tb->nr_inst; n ++) {
+    inst[n] = paddr_read(tb->pc + n * 4, 4);
+    if (!jit_can_translate(inst[n])) break;
+    count_regs(inst[n], nr_use);
+  }
+  if (n == 0) return;
+  alloc_regs(nr_use);
+
+  uint8_t *start = x86_p;
+  emit_prologue();
+  for (int k = 0; k < n; k ++) {
+    translate(inst[k], tb->pc + k * 4, k + 1);
+  }
+  uint32_t last = BITS(inst[n - 1], 6, 0);
+  if (last != 0x63 && last != 0x6f && last != 0x67) {
+    emit_exit(tb->pc + n * 4, -1, n);
+  }
+  Assert(x86_p - start <= JIT_MAX_BLOCK_SIZE, "JIT block too large");
+
+  for (int k = 0; k < n; k ++) {
+    paddr_t w = (tb->pc + k * 4 - CONFIG_MBASE) >> 2;
+    jit_word_map[w >> 3] |= 1 << (w & 7);
+    pmem_mark_code(tb->pc + k * 4, PMEM_CODE_JIT);
+  }
+  tb->host_code = start;
+#ifdef CONFIG_JIT_PERF_MAP
+  if (perf_map != NULL) {
+    fprintf(perf_map, "%lx %lx nemu-jit-" FMT_WORD "\n",
+        (unsigned long)(uintptr_t)start, (unsigned long)(x86_p - start), tb->pc);
+    fflush(perf_map);
+  }
+#endif
+}
+
+int jit_tb_exec(TBlock *tb, Decode *s) {
+  // 编译出的代码把虚拟地址当作物理地址访问，开启地址翻译后只能解释执行
+  if (isa_mmu_check(tb->pc, 4, MEM_TYPE_IFETCH) != MMU_DIRECT) return isa_tb_exec(tb, s);
+  if (tb->host_code == NULL && !jit_disabled && ++ tb->hot == JIT_HOT_THRESHOLD) {
+    jit_compile(tb);
+    // 编译前代码缓存满了会作废所有块，包括当前块
+    if (tb->nr_inst == 0) return 0;
+  }
+  if (tb->host_code == NULL) return isa_tb_exec(tb, s);
+  // 本机代码中途出错时只能指出块的起点，执行完后再补上块内其余的指令
+  IFDEF(CONFIG_ITRACE, iringbuf_fill(iringbuf_record(tb->pc), guest_to_host(tb->pc), 4));
+  int n = ((jit_block_t)tb->host_code)();
+#ifdef CONFIG_ITRACE
+  for (int k = 1; k < n; k ++) {
+    vaddr_t pc = tb->pc + k * 4;
+    iringbuf_fill(iringbuf_record(pc), guest_to_host(pc), 4);
+  }
+#endif
+  s->dnpc = cpu.pc;
+  return n;
+}
@@ -0,0 +1,205 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#ifndef __JIT_X86_H__
+#define __JIT_X86_H__
+
+// JIT 用到的 x86-64 指令编码，代码写到 x86_p 指向的缓冲区
+#include <common.h>
+
+enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+
+// 条件码，用于 jcc 和 setcc
+enum { CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_L = 0xc, CC_GE = 0xd };
+
+// 双操作数算术指令的操作码(op r/m32, r32)和对应的立即数形式扩展码(0x81 /ext)
+enum { ALU_ADD = 0x01, ALU_OR = 0x09, ALU_AND = 0x21, ALU_SUB = 0x29,
+       ALU_XOR = 0x31, ALU_CMP = 0x39, ALU_TEST = 0x85, ALU_MOV = 0x89 };
+enum { EXT_ADD = 0, EXT_OR = 1, EXT_AND = 4, EXT_SUB = 5, EXT_XOR = 6, EXT_CMP = 7 };
+enum { SHIFT_SHL = 4, SHIFT_SHR = 5, SHIFT_SAR = 7 };
+
+extern uint8_t *x86_p;
+
+static inline void x86_8(uint8_t b) { *x86_p ++ = b; }
+static inline void x86_32(uint32_t v) { memcpy(x86_p, &v, 4); x86_p += 4; }
+static inline void x86_64(uint64_t v) { memcpy(x86_p, &v, 8); x86_p += 8; }
+
+static inline void x86_rex(bool w, int reg, int index, int base, bool force) {
+  uint8_t rex = 0x40 | (w << 3) | ((reg >> 3) << 2) | ((index >> 3) << 1) | (base >> 3);
+  if (rex != 0x40 || force) x86_8(rex);
+}
+
+static inline void x86_modrm_rr(int reg, int rm) {
+  x86_8(0xc0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+// [base + disp32]
+static inline void x86_modrm_mem(int reg, int base, int32_t disp) {
+  x86_8(0x80 | ((reg & 7) << 3) | (base & 7));
+  if ((base & 7) == RSP) x86_8(0x24);
+  x86_32(disp);
+}
+
+// [base + index]，base 不能是 rbp/r13
+static inline void x86_modrm_sib(int reg, int base, int index) {
+  x86_8(0x04 | ((reg & 7) << 3));
+  x86_8(((index & 7) << 3) | (base & 7));
+}
+
+static inline void x86_alu_rr(int op, int dst, int src) {
+  x86_rex(0, src, 0, dst, false);
+  x86_8(op);
+  x86_modrm_rr(src, dst);
+}
+
+static inline void x86_alu_ri(int ext, int dst, uint32_t imm) {
+  x86_rex(0, 0, 0, dst, false);
+  x86_8(0x81);
+  x86_modrm_rr(ext, dst);
+  x86_32(imm);
+}
+
+static inline void x86_mov_ri(int dst, uint32_t imm) {
+  x86_rex(0, 0, 0, dst, false);
+  x86_8(0xb8 + (dst & 7));
+  x86_32(imm);
+}
+
+static inline void x86_movabs(int dst, uint64_t imm) {
+  x86_rex(1, 0, 0, dst, false);
+  x86_8(0xb8 + (dst & 7));
+  x86_64(imm);
+}
+
+static inline void x86_shift_ri(int ext, int dst, int imm, bool w) {
+  x86_rex(w, 0, 0, dst, false);
+  x86_8(0xc1);
+  x86_modrm_rr(ext, dst);
+  x86_8(imm);
+}
+
+// 移位量在 cl 中
+static inline void x86_shift_rcl(int ext, int dst) {
+  x86_rex(0, 0, 0, dst, false);
+  x86_8(0xd3);
+  x86_modrm_rr(ext, dst);
+}
+
+static inline void x86_imul_rr(int dst, int src, bool w) {
+  x86_rex(w, dst, 0, src, false);
+  x86_8(0x0f); x86_8(0xaf);
+  x86_modrm_rr(dst, src);
+}
+
+static inline void x86_movsxd(int dst, int src) {
+  x86_rex(1, dst, 0, src, false);
+  x86_8(0x63);
+  x86_modrm_rr(dst, src);
+}
+
+// 以 eax 为隐含操作数的乘除法：mul /4, div /6, idiv /7
+static inline void x86_muldiv(int ext, int src) {
+  x86_rex(0, 0, 0, src, false);
+  x86_8(0xf7);
+  x86_modrm_rr(ext, src);
+}
+
+static inline void x86_cdq() { x86_8(0x99); }
+
+// eax = (条件成立 ? 1 : 0)
+static inline void x86_setcc_eax(int cc) {
+  x86_8(0x0f); x86_8(0x90 | cc); x86_modrm_rr(0, RAX);
+  x86_8(0x0f); x86_8(0xb6); x86_modrm_rr(RAX, RAX);
+}
+
+// 把 eax 的低 len 字节做符号扩展
+static inline void x86_sext_eax(int len) {
+  x86_8(0x0f); x86_8(len == 1 ? 0xbe : 0xbf); x86_modrm_rr(RAX, RAX);
+}
+
+static inline void x86_load(int dst, int base, int32_t disp) {
+  x86_rex(0, dst, 0, base, false);
+  x86_8(0x8b);
+  x86_modrm_mem(dst, base, disp);
+}
+
+static inline void x86_store(int base, int32_t disp, int src) {
+  x86_rex(0, src, 0, base, false);
+  x86_8(0x89);
+  x86_modrm_mem(src, base, disp);
+}
+
+static inline void x86_store_imm(int base, int32_t disp, uint32_t imm) {
+  x86_rex(0, 0, 0, base, false);
+  x86_8(0xc7);
+  x86_modrm_mem(0, base, disp);
+  x86_32(imm);
+}
+
+// dst = 零扩展的 len 字节 [base + index]
+static inline void x86_load_idx(int dst, int base, int index, int len) {
+  x86_rex(0, dst, index, base, false);
+  switch (len) {
+    case 1: x86_8(0x0f); x86_8(0xb6); break;
+    case 2: x86_8(0x0f); x86_8(0xb7); break;
+    default: x86_8(0x8b); break;
+  }
+  x86_modrm_sib(dst, base, index);
+}
+
+// [base + index] = src 的低 len 字节
+static inline void x86_store_idx(int base, int index, int src, int len) {
+  if (len == 2) x86_8(0x66);
+  x86_rex(0, src, index, base, len == 1);
+  x86_8(len == 1 ? 0x88 : 0x89);
+  x86_modrm_sib(src, base, index);
+}
+
+// cmp byte [base + index], imm8
+static inline void x86_cmpb_idx(int base, int index, uint8_t imm) {
+  x86_rex(0, 0, index, base, false);
+  x86_8(0x80);
+  x86_modrm_sib(EXT_CMP, base, index);
+  x86_8(imm);
+}
+
+static inline void x86_push(int r) { x86_rex(0, 0, 0, r, false); x86_8(0x50 + (r & 7)); }
+static inline void x86_pop(int r)  { x86_rex(0, 0, 0, r, false); x86_8(0x58 + (r & 7)); }
+static inline void x86_ret() { x86_8(0xc3); }
+
+static inline void x86_call(const void *fn) {
+  x86_movabs(RAX, (uintptr_t)fn);
+  x86_8(0xff); x86_8(0xd0);
+}
+
+// 跳转的目标暂时留空，返回 rel32 的位置，由 x86_patch 回填
+static inline uint8_t* x86_jcc(int cc) {
+  x86_8(0x0f); x86_8(0x80 | cc); x86_32(0);
+  return x86_p - 4;
+}
+
+static inline uint8_t* x86_jmp() {
+  x86_8(0xe9); x86_32(0);
+  return x86_p - 4;
+}
+
+// 让 rel32 跳到当前位置
+static inline void x86_patch(uint8_t *rel) {
+  int32_t off = x86_p - (rel + 4);
+  memcpy(rel, &off, 4);
+}
+
+#endif
@@ -0,0 +1,100 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <isa.h>
+#include <cpu/cpu.h>
+#include <cpu/decode.h>
+#include <cpu/tb.h>
+#include <cpu/iringbuf.h>
+#include <monitor/breakpoint.h>
+
+#define TB_CACHE_SIZE 4096
+
+static TBlock tb_cache[TB_CACHE_SIZE] = {};
+
+static inline TBlock* tb_slot(vaddr_t pc) {
+  return &tb_cache[(pc >> 2) & (TB_CACHE_SIZE - 1)];
+}
+
+void tb_flush() {
+  for (int i = 0; i < TB_CACHE_SIZE; i ++) {
+    tb_cache[i].nr_inst = 0;
+    tb_cache[i].next[0] = tb_cache[i].next[1] = NULL;
+    IFDEF(CONFIG_JIT, tb_cache[i].host_code = NULL);
+  }
+}
+
+// 查找以 pc 开始的基本块，没有则尝试现场构造；返回 NULL 表示该 pc 还不能成块
+static TBlock* tb_find(vaddr_t pc) {
+  TBlock *tb = tb_slot(pc);
+  if (tb->pc == pc && tb->nr_inst > 0) return tb;
+  tb->pc = pc;
+  tb->next[0] = tb->next[1] = NULL;
+  IFDEF(CONFIG_JIT, tb->hot = 0; tb->host_code = NULL);
+  tb->nr_inst = isa_tb_build(tb);
+  return (tb->nr_inst > 0 ? tb : NULL);
+}
+
+// 沿着上一个块的链接找后继块，链接失效时再查表并重新链接
+static inline TBlock* tb_next(TBlock *prev, vaddr_t pc) {
+  if (prev != NULL) {
+    for (int i = 0; i < 2; i ++) {
+      TBlock *tb = prev->next[i];
+      if (tb != NULL && tb->pc == pc && tb->nr_inst > 0) return tb;
+    }
+  }
+  TBlock *tb = tb_find(pc);
+  if (prev != NULL && tb != NULL) {
+    prev->next[1] = prev->next[0];
+    prev->next[0] = tb;
+  }
+  return tb;
+}
+
+uint64_t tb_exec(uint64_t n) {
+  Decode s;
+  uint64_t nr_exec = 0;
+  TBlock *prev = NULL;
+  while (nr_exec < n) {
+    TBlock *tb = tb_next(prev, cpu.pc);
+    int k = 0;
+    if (tb != NULL && tb->nr_inst <= n - nr_exec) {
+      k = MUXDEF(CONFIG_JIT, jit_tb_exec(tb, &s), isa_tb_exec(tb, &s));
+    }
+    if (k == 0) {
+      // 还不能成块(指令尚未译码)或剩余指令数不足一个块，退回逐条解释执行
+      s.pc = cpu.pc;
+      s.snpc = cpu.pc;
+      IFDEF(CONFIG_ITRACE, iringbuf_entry_t *e = iringbuf_record(s.pc));
+      isa_exec_once(&s);
+      IFDEF(CONFIG_ITRACE, iringbuf_fill(e, &s.isa.inst, s.snpc - s.pc));
+      k = 1;
+      tb = NULL;
+    }
+    cpu.pc = s.dnpc;
+    nr_exec += k;
+    prev = tb;
+#ifdef CONFIG_BREAKPOINT
+    // 块不会跨过断点。命中但没有停下时也要返回，断点可能打开了需要逐条执行的追踪
+    if (has_breakpoints() && bp_at(cpu.pc)) {
+      if (bp_hit(cpu.pc)) nemu_state.state = NEMU_STOP;
+      break;
+    }
+#endif
+    if (nemu_state.state != NEMU_RUNNING) break;
+  }
+  return nr_exec;
+}
@@ -17,6 +17,33 @@ SRCS-y += src/nemu-main.c
 DIRS-y += src/cpu src/monitor src/utils
 DIRS-$(CONFIG_MODE_SYSTEM) += src/memory
 DIRS-BLACKLIST-$(CONFIG_TARGET_AM) += src/monitor/sdb
+ifndef CONFIG_BREAKPOINT
+SRCS-BLACKLIST-y += src/monitor/sdb/breakpoint.c
+endif
+ifndef CONFIG_SNAPSHOT
+SRCS-BLACKLIST-y += src/monitor/snapshot.c
+endif
+ifndef CONFIG_SIMPOINT
+SRCS-BLACKLIST-y += src/cpu/simpoint.c
+endif
+ifndef CONFIG_PC_PROFILE
+SRCS-BLACKLIST-y += src/cpu/pcprof.c
+endif
+ifndef CONFIG_CALL_PROFILE
+SRCS-BLACKLIST-y += src/cpu/callprof.c
+endif
+ifndef CONFIG_INST_STAT
+SRCS-BLACKLIST-y += src/cpu/inststat.c
+endif
+ifndef CONFIG_CACHE_SIM
+SRCS-BLACKLIST-y += src/cpu/cachesim.c
+endif
+ifndef CONFIG_BPRED
+SRCS-BLACKLIST-y += src/cpu/bpred.c
+endif
+ifndef CONFIG_TIMING
+SRCS-BLACKLIST-y += src/cpu/timing.c
+endif
 
 SHARE = $(if $(CONFIG_TARGET_SHARE),1,0)
 LIBS += $(if $(CONFIG_TARGET_NATIVE_ELF),-lreadline -ldl -pie,)
@@ -26,6 +26,17 @@ const char *regs[] = {
 void isa_reg_display() {
 }
 
+// 返回寄存器在 cpu 中的地址，表达式编译时用它把寄存器名解析成固定的位置
+const word_t* isa_reg_str2ptr(const char *s) {
+  if (strcmp(s, "pc") == 0) return &cpu.pc;
+  for (int i = 0; i < 32; i ++) {
+    if (strcmp(regs[i], s) == 0) return &cpu.gpr[i];
+  }
+  return NULL;
+}
+
 word_t isa_reg_str2val(const char *s, bool *success) {
-  return 0;
+  const word_t *p = isa_reg_str2ptr(s);
+  *success = (p != NULL);
+  return p ? *p : 0;
 }
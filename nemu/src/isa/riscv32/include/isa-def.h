@@ -23,6 +23,8 @@ typedef struct {
   vaddr_t mepc; 
   word_t mstatus;
   word_t mcause;
+  word_t mtval;
+  word_t satp;
 } MUXDEF(CONFIG_RV64, riscv64_CSRS, riscv32_CSRS);
  
 typedef struct {
@@ -36,6 +38,11 @@ typedef struct {
   uint32_t inst;
 } MUXDEF(CONFIG_RV64, riscv64_ISADecodeInfo, riscv32_ISADecodeInfo);
 
+#ifdef CONFIG_RV_SV32
+// satp.MODE 为 1 时按 Sv32 翻译地址，这里不区分特权级
+#define isa_mmu_check(vaddr, len, type) ((cpu.csr.satp >> 31) ? MMU_TRANSLATE : MMU_DIRECT)
+#else
 #define isa_mmu_check(vaddr, len, type) (MMU_DIRECT)
+#endif
 
 #endif
@@ -14,15 +14,35 @@
 ***************************************************************************************/
 
 #include "local-include/reg.h"
+#include "local-include/mmu.h"
 #include <cpu/cpu.h>
 #include <cpu/ifetch.h>
 #include <cpu/decode.h>
+#include <cpu/tb.h>
+#include <cpu/iringbuf.h>
+#include <memory/paddr.h>
 #include <monitor/ftrace.h>
+#include <monitor/breakpoint.h>
+#ifdef CONFIG_INST_STAT
+#include <cpu/inststat.h>
+#endif
+#ifdef CONFIG_BPRED
+#include <cpu/bpred.h>
+#endif
+#ifdef CONFIG_TIMING
+#include <cpu/timing.h>
+#endif
 
 #define R(i) gpr(i)
 #define Mr vaddr_read
 #define Mw vaddr_write
 
+// 读内存发生缺页异常时不能改写 rd
+#define Ld(val) do { \
+  word_t __val = (val); \
+  if (likely(MUXDEF(CONFIG_RV_SV32, mmu_exception == INTR_EMPTY, true))) R(rd) = __val; \
+} while (0)
+
 enum {
   TYPE_I, TYPE_U, TYPE_S,
   TYPE_R, TYPE_B, TYPE_J,  // 添加R型、B型和J型指令格式
@@ -57,14 +77,204 @@ static void decode_operand(Decode *s, int *rd, word_t *src1, word_t *src2, word_
   }
 }
 
-static int decode_exec(Decode *s) {
+// 译码缓存：以 PC 为索引，记录每条指令匹配到的 INSTPAT 执行体(标签地址)和译码出的操作数，
+// 命中时跳过取指、模式匹配和 decode_operand，直接跳到执行体
+typedef struct {
+  uint64_t key;       // vm_ctx | pc，同一地址在不同地址空间中是不同的项
+  paddr_t ppc;        // 指令的物理地址，guest 改写代码时按它作废
+  uint32_t inst;
+  uint8_t rd, rs1, rs2;
+  word_t imm;
+  const void *exec;   // NULL 表示该项无效
+} DecodeCacheEntry;
+
+static inline uint64_t decode_cache_key(vaddr_t pc) {
+  return vm_ctx | pc;
+}
+
+#ifdef CONFIG_DECODE_CACHE
+#define DECODE_CACHE_SIZE CONFIG_DECODE_CACHE_SIZE
+static_assert((DECODE_CACHE_SIZE & (DECODE_CACHE_SIZE - 1)) == 0,
+    "DECODE_CACHE_SIZE must be a power of 2");
+
+/* 同一虚拟页中的指令落在同一组连续的 DC_PAGE_ENTRIES 项中，组内按页内偏移排列，
+ * 组号混入了地址空间编号，不同进程中的同一地址一般不会互相挤出。
+ */
+#define DC_PAGE_ENTRIES (PAGE_SIZE / 4)
+#define DC_NR_GROUP (DECODE_CACHE_SIZE / DC_PAGE_ENTRIES)
+static_assert(DECODE_CACHE_SIZE >= DC_PAGE_ENTRIES, "DECODE_CACHE_SIZE must hold a whole page");
+
+static DecodeCacheEntry decode_cache[DECODE_CACHE_SIZE] = {};
+
+/* 每个 pmem 页在译码缓存中的有效项数，以及这些项所在的组(组号模 64 记在位图中)。
+ * guest 写代码页时只检查这些组中与被写地址对应的项；项数降到 0 时取消代码页标记，
+ * 之后对这一页的写不再经过这里。
+ */
+#define NR_PMEM_PAGE (CONFIG_MSIZE >> PAGE_SHIFT)
+static uint32_t code_nr_entry[NR_PMEM_PAGE] = {};
+static uint64_t code_group[NR_PMEM_PAGE] = {};
+
+static inline DecodeCacheEntry* decode_cache_slot(vaddr_t pc, uint32_t ctx) {
+  return &decode_cache[((pc >> 2) ^ (ctx * DC_PAGE_ENTRIES)) & (DECODE_CACHE_SIZE - 1)];
+}
+
+static inline DecodeCacheEntry* decode_cache_entry(vaddr_t pc) {
+  return decode_cache_slot(pc, vm_ctx >> 32);
+}
+
+static inline const DecodeCacheEntry* decode_cache_lookup(vaddr_t pc) {
+  DecodeCacheEntry *e = decode_cache_entry(pc);
+  return (likely(e->key == decode_cache_key(pc) && e->exec != NULL) ? e : NULL);
+}
+
+// 作废的缓存项同时把 key 改成不可能出现的值，这样引用它的基本块在分派时就能发现
+static inline void decode_cache_kill(DecodeCacheEntry *e) {
+  if (e->exec == NULL) return;
+  paddr_t page = (e->ppc - CONFIG_MBASE) >> PAGE_SHIFT;
+  if (-- code_nr_entry[page] == 0) {
+    code_group[page] = 0;
+    pmem_unmark_code(e->ppc, PMEM_CODE_DECODE);
+  }
+  e->key = (uint64_t)-1;
+  e->exec = NULL;
+}
+
+static inline void decode_cache_fill(Decode *s, int rd, word_t imm, int type, const void *exec) {
+  // 只缓存从 pmem 取出的指令，MMIO 中的代码每次都重新取指
+  paddr_t paddr;
+  if (!vaddr_peek(s->pc, MEM_TYPE_IFETCH, &paddr) || !in_pmem(paddr)) return;
+  uint32_t i = s->isa.inst;
+  bool has_src1 = (type == TYPE_I || type == TYPE_S || type == TYPE_R || type == TYPE_B);
+  bool has_src2 = (type == TYPE_S || type == TYPE_R || type == TYPE_B);
+  DecodeCacheEntry *e = decode_cache_entry(s->pc);
+  decode_cache_kill(e);
+  paddr_t page = (paddr - CONFIG_MBASE) >> PAGE_SHIFT;
+  code_nr_entry[page] ++;
+  code_group[page] |= 1ull << ((e - decode_cache) / DC_PAGE_ENTRIES % 64);
+  pmem_mark_code(paddr, PMEM_CODE_DECODE);
+  *e = (DecodeCacheEntry) { .key = decode_cache_key(s->pc), .ppc = paddr, .inst = i, .rd = rd,
+    .rs1 = (has_src1 ? BITS(i, 19, 15) : 0), .rs2 = (has_src2 ? BITS(i, 24, 20) : 0),
+    .imm = imm, .exec = exec };
+}
+
+// 由 paddr_write 调用：guest 改写了自己的代码时，按物理地址作废对应的缓存项
+void isa_decode_cache_invalidate(paddr_t addr, int len) {
+  paddr_t end = (addr + len - 1) & ~(paddr_t)0x3;
+  for (paddr_t a = addr & ~(paddr_t)0x3; a <= end && in_pmem(a); a += 4) {
+    uint64_t groups = code_group[(a - CONFIG_MBASE) >> PAGE_SHIFT];
+    while (groups != 0) {
+      int b = __builtin_ctzll(groups);
+      groups &= groups - 1;
+      for (int g = b; g < DC_NR_GROUP; g += 64) {
+        DecodeCacheEntry *e = &decode_cache[g * DC_PAGE_ENTRIES + ((a & PAGE_MASK) >> 2)];
+        if (e->exec != NULL && e->ppc == a) decode_cache_kill(e);
+      }
+    }
+  }
+}
+
+// 作废地址空间 ctx 中虚拟页 vpage 的缓存项，它们在同一组中
+void isa_decode_cache_flush_page(vaddr_t vpage, uint32_t ctx) {
+  uint64_t key = (uint64_t)ctx << 32 | vpage;
+  DecodeCacheEntry *e = decode_cache_slot(vpage, ctx);
+  for (int i = 0; i < DC_PAGE_ENTRIES; i ++) {
+    if (e[i].key == key + i * 4) decode_cache_kill(&e[i]);
+  }
+}
+
+void isa_decode_cache_flush() {
+  for (int i = 0; i < DECODE_CACHE_SIZE; i ++) {
+    decode_cache[i].key = (uint64_t)-1;
+    decode_cache[i].exec = NULL;
+  }
+  memset(code_nr_entry, 0, sizeof(code_nr_entry));
+  memset(code_group, 0, sizeof(code_group));
+  pmem_unmark_code_all(PMEM_CODE_DECODE);
+}
+#endif
+
+#ifdef CONFIG_INST_STAT
+// 按 opcode 给执行完的指令分类，taken 表示分支是否跳转
+static inline void inst_stat_count(uint32_t i, bool taken) {
+  int cls;
+  switch (BITS(i, 6, 0)) {
+    case 0x37: case 0x17: case 0x13: cls = INST_ALU; break;
+    case 0x33: cls = (BITS(i, 31, 25) == 1 ? INST_MULDIV : INST_ALU); break;
+    case 0x03: cls = INST_LOAD_B + (BITS(i, 13, 12) == 3 ? 2 : BITS(i, 13, 12)); break;
+    case 0x23: cls = INST_STORE_B + (BITS(i, 13, 12) == 3 ? 2 : BITS(i, 13, 12)); break;
+    case 0x63: cls = (taken ? INST_BRANCH_TAKEN : INST_BRANCH_NOT_TAKEN); break;
+    case 0x6f: case 0x67: cls = INST_JUMP; break;
+    case 0x73: cls = (BITS(i, 14, 12) != 0 ? INST_CSR : (i == 0x73 ? INST_ECALL : INST_SYSTEM)); break;
+    default: cls = INST_OTHER; break;
+  }
+  inst_stat[cls] ++;
+}
+#endif
+
+#ifdef CONFIG_BPRED
+// 把执行完的控制转移指令报告给分支预测器，调用和返回与 jal/jalr 的执行体一样按 rd 和 rs1 判断
+static inline void bpred_exec(Decode *s) {
+  uint32_t i = s->isa.inst;
+  int rd = BITS(i, 11, 7), rs1 = BITS(i, 19, 15);
+  switch (BITS(i, 6, 0)) {
+    case 0x63: {
+      word_t imm = SEXT(BITS(i, 31, 31), 1) << 12 | BITS(i, 7, 7) << 11 | BITS(i, 30, 25) << 5 | BITS(i, 11, 8) << 1;
+      bpred_branch(s->pc, BR_COND, s->dnpc != s->snpc, s->pc + imm);
+      break;
+    }
+    case 0x6f: bpred_branch(s->pc, (rd == 1 ? BR_CALL : BR_JUMP), true, s->dnpc); break;
+    case 0x67:
+      bpred_branch(s->pc, (rd == 1 && rs1 != 1 ? BR_IND_CALL : (rd == 0 && rs1 == 1 ? BR_RET : BR_IND)), true, s->dnpc);
+      break;
+  }
+}
+#endif
+
+#ifdef CONFIG_TIMING
+// 把执行完的指令的类别和实际读写的寄存器报告给时序模型，store 的数据可以前递到 MEM 级，不算依赖
+static inline void timing_exec(Decode *s) {
+  uint32_t i = s->isa.inst;
+  int rd = BITS(i, 11, 7), rs1 = BITS(i, 19, 15), rs2 = BITS(i, 24, 20);
+  int cls;
+  switch (BITS(i, 6, 0)) {
+    case 0x37: case 0x17: cls = T_ALU; rs1 = rs2 = 0; break;
+    case 0x13: cls = T_ALU; rs2 = 0; break;
+    case 0x33: cls = (BITS(i, 31, 25) == 1 ? (BITS(i, 14, 14) ? T_DIV : T_MUL) : T_ALU); break;
+    case 0x03: cls = T_LOAD; rs2 = 0; break;
+    case 0x23: cls = T_STORE; rd = rs2 = 0; break;
+    case 0x63: cls = T_BRANCH; rd = 0; break;
+    case 0x6f: cls = T_JUMP; rs1 = rs2 = 0; break;
+    case 0x67: cls = T_JUMP_IND; rs2 = 0; break;
+    // csrrwi/csrrsi/csrrci 的 rs1 字段是立即数
+    case 0x73: cls = T_SYSTEM; rs2 = 0; if (BITS(i, 14, 14)) rs1 = 0; break;
+    default: cls = T_ALU; rs1 = rs2 = 0; break;
+  }
+  timing_inst(s->pc, cls, rd, rs1, rs2, s->dnpc != s->snpc);
+}
+#endif
+
+/* 依次执行 op 中的 nr_op 条指令，返回实际执行的条数。
+ * op[i] 是译码缓存项，命中时直接跳到执行体；op[0] 为 NULL 时现场做模式匹配。
+ * 只要下一条指令仍是顺序执行且缓存项没有被作废，就用 computed goto 直接分派，
+ * 不再返回到 cpu_exec，这就是线程化执行引擎的内层循环。
+ * 缓存中保存的是本函数内标签的地址，必须保证它只有一份实体，因此禁止内联。
+ */
+__attribute__((noinline))
+static int decode_exec(Decode *s, const DecodeCacheEntry *const *op, int nr_op) {
+  int rd = 0;
+  word_t src1 = 0, src2 = 0, imm = 0;
+  const DecodeCacheEntry *e = op[0];
+  int nr_exec = 0;
+
+next_inst:
   s->dnpc = s->snpc;//默认情况下下一pc是静态下一pc
 
 #define INSTPAT_INST(s) ((s)->isa.inst)//获取当前指令
 #define INSTPAT_MATCH(s, name, type, ... /* execute body */ ) { \
-  int rd = 0; \
-  word_t src1 = 0, src2 = 0, imm = 0; \
   decode_operand(s, &rd, &src1, &src2, &imm, concat(TYPE_, type)); \
+  IFDEF(CONFIG_DECODE_CACHE, decode_cache_fill(s, rd, imm, concat(TYPE_, type), \
+        &&concat(__instpat_exec_, __LINE__))); \
+  IFDEF(CONFIG_DECODE_CACHE, concat(__instpat_exec_, __LINE__): ;) \
   __VA_ARGS__ ; \
 }
 //解码指令，获取操作数，然后执行指令体
@@ -81,9 +291,19 @@ imm - 立即数
 
 */
 
+#ifdef CONFIG_DECODE_CACHE
+  if (e != NULL) {
+    // 命中译码缓存：立即数已经算好，只需重新读取源寄存器的当前值
+    rd = e->rd;
+    src1 = R(e->rs1);
+    src2 = R(e->rs2);
+    imm = e->imm;
+    goto *(e->exec);
+  }
+#endif
   INSTPAT_START();//目的是生成一个标签，用于跳转
   INSTPAT("??????? ????? ????? ??? ????? 00101 11", auipc  , U, R(rd) = s->pc + imm);
-  INSTPAT("??????? ????? ????? 100 ????? 00000 11", lbu    , I, R(rd) = Mr(src1 + imm, 1));
+  INSTPAT("??????? ????? ????? 100 ????? 00000 11", lbu    , I, Ld(Mr(src1 + imm, 1)));
   INSTPAT("??????? ????? ????? 000 ????? 01000 11", sb     , S, Mw(src1 + imm, 1, src2));
   
   // 添加基本算术运算指令
@@ -131,12 +351,12 @@ imm - 立即数
   
   // 添加内存加载指令
   INSTPAT("??????? ????? ????? 000 ????? 00000 11", lb, I,
-          R(rd) = SEXT(Mr(src1 + imm, 1), 8));
-  INSTPAT("??????? ????? ????? 010 ????? 00000 11", lw     , I, R(rd) = Mr(src1 + imm, 4));
-  INSTPAT("??????? ????? ????? 001 ????? 00000 11", lh     , I, R(rd) = SEXT(Mr(src1 + imm, 2), 16));
-  INSTPAT("??????? ????? ????? 101 ????? 00000 11", lhu    , I, R(rd) = Mr(src1 + imm, 2));
+          Ld(SEXT(Mr(src1 + imm, 1), 8)));
+  INSTPAT("??????? ????? ????? 010 ????? 00000 11", lw     , I, Ld(Mr(src1 + imm, 4)));
+  INSTPAT("??????? ????? ????? 001 ????? 00000 11", lh     , I, Ld(SEXT(Mr(src1 + imm, 2), 16)));
+  INSTPAT("??????? ????? ????? 101 ????? 00000 11", lhu    , I, Ld(Mr(src1 + imm, 2)));
   INSTPAT("??????? ????? ????? 100 ????? 00000 11", lbu, I,
-          R(rd) = Mr(src1 + imm, 1));
+          Ld(Mr(src1 + imm, 1)));
 
   // 添加内存存储指令
   INSTPAT("??????? ????? ????? 010 ????? 01000 11", sw     , S, Mw(src1 + imm, 4, src2));
@@ -199,6 +419,15 @@ imm - 立即数
       old_val = cpu.csr.mcause;
       cpu.csr.mcause = src1;
       break;
+    case 0x343: // mtval
+      old_val = cpu.csr.mtval;
+      cpu.csr.mtval = src1;
+      break;
+    case 0x180: // satp
+      old_val = cpu.csr.satp;
+      cpu.csr.satp = src1;
+      IFDEF(CONFIG_RV_SV32, if (src1 != old_val) mmu_update_ctx());
+      break;
     // 可以根据需要添加其他 CSR 寄存器
     default:
       // 未实现的 CSR
@@ -238,6 +467,18 @@ imm - 立即数
       if (src1 != 0)
         cpu.csr.mcause |= src1;
       break;
+    case 0x343: // mtval
+      old_val = cpu.csr.mtval;
+      if (src1 != 0)
+        cpu.csr.mtval |= src1;
+      break;
+    case 0x180: // satp
+      old_val = cpu.csr.satp;
+      if ((old_val | src1) != old_val) {
+        cpu.csr.satp |= src1;
+        IFDEF(CONFIG_RV_SV32, mmu_update_ctx());
+      }
+      break;
     default:
       panic("CSR address 0x%x not implemented", csr);
     }
@@ -264,21 +505,120 @@ imm - 立即数
     // 简化版本暂不处理mstatus的状态变化
   });
 
+  // sfence.vma：页表可能被改写，作废 TLB 以及按虚拟地址缓存的内容
+  INSTPAT("0001001 ????? ????? 000 00000 11100 11", sfence.vma, R, {
+    IFDEF(CONFIG_RV_SV32, mmu_tlb_flush(src1, BITS(s->isa.inst, 19, 15) == 0,
+          BITS(src2, 8, 0), BITS(s->isa.inst, 24, 20) == 0));
+  });
+
   // 已有的特殊指令
   INSTPAT("??????? ????? ????? ??? ????? ????? ??", inv    , N, INV(s->pc));
   INSTPAT_END();
 
+#ifdef CONFIG_RV_SV32
+  if (unlikely(mmu_exception != INTR_EMPTY)) {
+    s->dnpc = isa_raise_intr(mmu_exception, s->pc);
+    mmu_exception = INTR_EMPTY;
+  }
+#endif
   R(0) = 0; // reset $zero to 0
+  IFDEF(CONFIG_INST_STAT, inst_stat_count(s->isa.inst, s->dnpc != s->snpc));
+  IFDEF(CONFIG_BPRED, if (bpred_active) bpred_exec(s));
+  // 要在分支预测之后，分支的代价取决于是否预测错误
+  IFDEF(CONFIG_TIMING, if (timing_active) timing_exec(s));
+  nr_exec ++;
 
-  return 0;
+  // 顺序流向下一条指令，且它的缓存项仍然有效时，直接分派
+  if (nr_exec < nr_op && s->dnpc == s->snpc && nemu_state.state == NEMU_RUNNING) {
+    e = op[nr_exec];
+    if (likely(e->key == decode_cache_key(s->dnpc))) {
+      s->pc = s->dnpc;
+      s->snpc = s->dnpc + 4;
+      s->isa.inst = e->inst;
+      // 数据监视点命中时报告的是 cpu.pc
+      IFDEF(CONFIG_WATCHPOINT, cpu.pc = s->pc);
+      IFDEF(CONFIG_ITRACE, iringbuf_fill(iringbuf_record(s->pc), &e->inst, 4));
+      goto next_inst;
+    }
+  }
+
+  return nr_exec;
 }//hy:可能需要在这里加东西
 
 int isa_exec_once(Decode *s) {
-  s->isa.inst = inst_fetch(&s->snpc, 4);
+  const DecodeCacheEntry *e = MUXDEF(CONFIG_DECODE_CACHE, decode_cache_lookup(s->pc), NULL);
+  if (e != NULL) {
+    // 命中译码缓存，指令字直接从缓存项中取得，不再访存
+    s->isa.inst = e->inst;
+    s->snpc += 4;
+  } else {
+    s->isa.inst = inst_fetch(&s->snpc, 4);
+#ifdef CONFIG_RV_SV32
+    if (unlikely(mmu_exception != INTR_EMPTY)) {
+      s->dnpc = isa_raise_intr(mmu_exception, s->pc);
+      mmu_exception = INTR_EMPTY;
+      return 0;
+    }
+#endif
+  }
   /*
   调用 inst_fetch 函数从当前指令地址 (s->snpc) 处获取一个 4 字节的指令
   指令被读取并存储在 s->isa.inst 中
   &s->snpc 作为引用参数传递，在取指后会被更新为下一条
   */
-  return decode_exec(s);
+  decode_exec(s, &e, 1);
+  return 0;
+}
+
+// 会改变控制流或处理器状态的指令结束一个基本块：分支、jal、jalr 以及 SYSTEM 类指令
+static inline bool tb_end_inst(uint32_t inst) {
+  switch (BITS(inst, 6, 0)) {
+    case 0x63: case 0x6f: case 0x67: case 0x73: return true;
+    default: return false;
+  }
+}
+
+bool isa_bb_end(Decode *s) {
+  return tb_end_inst(s->isa.inst);
+}
+
+#ifdef CONFIG_ENGINE_THREADED
+
+// 用译码缓存中已有的项拼出从 tb->pc 开始的基本块，遇到未译码的指令或页边界就提前结束
+int isa_tb_build(TBlock *tb) {
+  vaddr_t pc = tb->pc;
+  int n = 0;
+  while (n < TB_MAX_INST) {
+    const DecodeCacheEntry *e = decode_cache_lookup(pc);
+    if (e == NULL) break;
+#ifdef CONFIG_BREAKPOINT
+    // 有断点的指令只能是块的第一条，执行循环在块的边界上检查断点
+    if (n > 0 && has_breakpoints() && bp_at(pc)) break;
+#endif
+    tb->op[n ++] = e;
+    if (tb_end_inst(e->inst)) break;
+    pc += 4;
+    if ((pc & PAGE_MASK) == 0) break;
+  }
+  return n;
+}
+
+int isa_tb_exec(TBlock *tb, Decode *s) {
+  const DecodeCacheEntry *const *op = (const DecodeCacheEntry *const *)tb->op;
+  if (unlikely(op[0]->key != decode_cache_key(tb->pc))) {
+    tb->nr_inst = 0;
+    return 0;
+  }
+  s->pc = tb->pc;
+  s->snpc = tb->pc + 4;
+  s->isa.inst = op[0]->inst;
+  // 块内的指令不经过 cpu-exec 的执行循环，在这里逐条记入环形缓冲区
+  IFDEF(CONFIG_ITRACE, iringbuf_fill(iringbuf_record(s->pc), &s->isa.inst, 4));
+  int n = decode_exec(s, op, tb->nr_inst);
+  if (n < tb->nr_inst && s->dnpc == s->snpc && nemu_state.state == NEMU_RUNNING) {
+    // 顺序执行却在块的中途停下，说明块内的代码已被改写，作废整个块
+    tb->nr_inst = 0;
+  }
+  return n;
 }
+#endif
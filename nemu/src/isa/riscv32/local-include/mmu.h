@@ -0,0 +1,40 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#ifndef __RISCV_MMU_H__
+#define __RISCV_MMU_H__
+
+#include <common.h>
+
+#define SATP_ASID(satp) BITS(satp, 30, 22)
+
+enum {
+  EXC_INST_ACCESS_FAULT = 1,
+  EXC_LOAD_ACCESS_FAULT = 5,
+  EXC_STORE_ACCESS_FAULT = 7,
+  EXC_INST_PAGE_FAULT = 12,
+  EXC_LOAD_PAGE_FAULT = 13,
+  EXC_STORE_PAGE_FAULT = 15,
+};
+
+/* 地址翻译失败时记下的异常号，INTR_EMPTY 表示没有。
+ * 访存函数在失败时不做任何事，由执行完指令后的检查抛出异常。
+ */
+extern word_t mmu_exception;
+
+void mmu_tlb_flush(vaddr_t vaddr, bool all_vaddr, word_t asid, bool all_asid);
+void mmu_update_ctx();
+
+#endif
@@ -31,12 +31,11 @@ void isa_reg_display() {
   printf("pc = 0x%08x\n", cpu.pc);
 }
 
-word_t isa_reg_str2val(const char *s, bool *success) {
-  *success = true;
-  
+// 返回寄存器在 cpu 中的地址，表达式编译时用它把寄存器名解析成固定的位置
+const word_t* isa_reg_str2ptr(const char *s) {
   // 特殊处理程序计数器
   if (strcmp(s, "pc") == 0) {
-    return cpu.pc;
+    return &cpu.pc;
   }
   
   // 处理$x数字形式的寄存器名，例如$0, $1, $2...
@@ -44,18 +43,23 @@ word_t isa_reg_str2val(const char *s, bool *success) {
     int idx = 0;
     sscanf(s + 1, "%d", &idx);
     if (idx >= 0 && idx < 32) {
-      return cpu.gpr[idx];
+      return &cpu.gpr[idx];
     }
   }
   
   // 处理符号名形式的寄存器
   for (int i = 0; i < 32; i++) {
     if (strcmp(regs[i], s) == 0) {
-      return cpu.gpr[i];
+      return &cpu.gpr[i];
     }
   }
   
   // 如果没找到匹配的寄存器名
-  *success = false;
-  return 0;
+  return NULL;
+}
+
+word_t isa_reg_str2val(const char *s, bool *success) {
+  const word_t *p = isa_reg_str2ptr(s);
+  *success = (p != NULL);
+  return p ? *p : 0;
 }
@@ -16,7 +16,205 @@
 #include <isa.h>
 #include <memory/vaddr.h>
 #include <memory/paddr.h>
+#include "../local-include/mmu.h"
+
+#ifdef CONFIG_RV_SV32
+#define PTE_V 0x01
+#define PTE_R 0x02
+#define PTE_W 0x04
+#define PTE_X 0x08
+#define PTE_G 0x20
+#define PTE_PPN(pte) ((pte) >> 10)
+
+#define TLB_SIZE CONFIG_RV_TLB_SIZE
+static_assert((TLB_SIZE & (TLB_SIZE - 1)) == 0, "RV_TLB_SIZE must be a power of 2");
+
+/* 直接映射的 TLB，按 4KB 虚拟页号索引，大页也拆成 4KB 的页存放。
+ * 表项带有地址空间编号，切换地址空间时不必清空；ASID 用于 sfence.vma；perm 为 0 表示无效。
+ */
+typedef struct {
+  uint32_t vpn;
+  uint32_t ppn;
+  uint32_t ctx;
+  uint16_t asid;
+  uint8_t perm;   // PTE 中的 V/R/W/X/G 位
+} TLBEntry;
+
+static TLBEntry tlb[TLB_SIZE] = {};
+
+/* 最近用过的 satp 对应的地址空间编号(见 vm_ctx)。编号按整个 satp 分配，
+ * 即使软件让所有进程共用 ASID 0 而切换时不执行 sfence.vma，也不会用错翻译结果。
+ * 编号从 1 开始递增，不会重复使用；被挤出或被 sfence.vma 作废的 satp 再次出现时分配新的编号。
+ */
+#define NR_VM_CTX 16
+static struct { word_t satp; uint32_t id; } vm_ctx_tab[NR_VM_CTX] = {};
+static int vm_ctx_victim = 0;
+static uint32_t vm_ctx_last = 0;
+
+static inline uint32_t cur_ctx() {
+  return vm_ctx >> 32;
+}
+
+static uint32_t ctx_of_satp(word_t satp) {
+  for (int i = 0; i < NR_VM_CTX; i ++) {
+    if (vm_ctx_tab[i].id != 0 && vm_ctx_tab[i].satp == satp) return vm_ctx_tab[i].id;
+  }
+  if (unlikely(++ vm_ctx_last == 0)) {
+    // 编号用完了，作废所有按编号缓存的内容后重新开始
+    memset(vm_ctx_tab, 0, sizeof(vm_ctx_tab));
+    memset(tlb, 0, sizeof(tlb));
+    IFDEF(CONFIG_SOFT_TLB, soft_tlb_flush());
+    IFDEF(CONFIG_DECODE_CACHE, isa_decode_cache_flush());
+    vm_ctx_last = 1;
+  }
+  vm_ctx_tab[vm_ctx_victim].satp = satp;
+  vm_ctx_tab[vm_ctx_victim].id = vm_ctx_last;
+  vm_ctx_victim = (vm_ctx_victim + 1) % NR_VM_CTX;
+  return vm_ctx_last;
+}
+
+// satp 被改写之后调用，切换到它对应的地址空间
+void mmu_update_ctx() {
+  vm_ctx = (isa_mmu_check(0, 4, MEM_TYPE_IFETCH) == MMU_TRANSLATE ?
+      (uint64_t)ctx_of_satp(cpu.csr.satp) << 32 : 0);
+}
+static uint64_t tlb_hit = 0, tlb_miss = 0;
+word_t mmu_exception = INTR_EMPTY;
+
+static const uint8_t type_perm[] = {
+  [MEM_TYPE_IFETCH] = PTE_X, [MEM_TYPE_READ] = PTE_R, [MEM_TYPE_WRITE] = PTE_W,
+};
+
+// page_walk 的结果
+enum { WALK_OK, WALK_PAGE_FAULT, WALK_ACCESS_FAULT };
+
+static const word_t type_exception[][3] = {
+  [WALK_PAGE_FAULT] = {
+    [MEM_TYPE_IFETCH] = EXC_INST_PAGE_FAULT,
+    [MEM_TYPE_READ]   = EXC_LOAD_PAGE_FAULT,
+    [MEM_TYPE_WRITE]  = EXC_STORE_PAGE_FAULT,
+  },
+  [WALK_ACCESS_FAULT] = {
+    [MEM_TYPE_IFETCH] = EXC_INST_ACCESS_FAULT,
+    [MEM_TYPE_READ]   = EXC_LOAD_ACCESS_FAULT,
+    [MEM_TYPE_WRITE]  = EXC_STORE_ACCESS_FAULT,
+  },
+};
+
+static inline TLBEntry* tlb_entry(uint32_t vpn) {
+  return &tlb[vpn & (TLB_SIZE - 1)];
+}
+
+static inline bool tlb_match(const TLBEntry *e, uint32_t vpn) {
+  return e->vpn == vpn && e->perm != 0 && ((e->perm & PTE_G) || e->ctx == cur_ctx());
+}
+
+/* 查两级页表，成功时把翻译结果写到 e 中，页表项不在 pmem 中时是访问错误。
+ * A/D 位既不检查也不更新；没有实现 S/U 特权级，U 位也不检查
+ */
+static int page_walk(vaddr_t vaddr, TLBEntry *e) {
+  paddr_t base = (paddr_t)BITS(cpu.csr.satp, 21, 0) << PAGE_SHIFT;
+  for (int level = 1; level >= 0; level --) {
+    paddr_t pte_addr = base + (level == 1 ? BITS(vaddr, 31, 22) : BITS(vaddr, 21, 12)) * 4;
+    if (!in_pmem(pte_addr)) return WALK_ACCESS_FAULT;
+    word_t pte = paddr_read(pte_addr, 4);
+    if (!(pte & PTE_V) || ((pte & PTE_W) && !(pte & PTE_R))) return WALK_PAGE_FAULT;
+    if (pte & (PTE_R | PTE_X)) {
+      uint32_t ppn = PTE_PPN(pte);
+      if (level == 1) {
+        // 大页的物理页号必须按 4MB 对齐
+        if (BITS(ppn, 9, 0) != 0) return WALK_PAGE_FAULT;
+        ppn |= BITS(vaddr, 21, 12);
+      }
+      *e = (TLBEntry){ .vpn = vaddr >> PAGE_SHIFT, .ppn = ppn, .ctx = cur_ctx(),
+        .asid = SATP_ASID(cpu.csr.satp), .perm = pte & (PTE_V | PTE_R | PTE_W | PTE_X | PTE_G) };
+      return WALK_OK;
+    }
+    base = (paddr_t)PTE_PPN(pte) << PAGE_SHIFT;
+  }
+  return WALK_PAGE_FAULT;
+}
 
 paddr_t isa_mmu_translate(vaddr_t vaddr, int len, int type) {
+  uint32_t vpn = vaddr >> PAGE_SHIFT;
+  TLBEntry *e = tlb_entry(vpn);
+  int status = WALK_OK;
+  if (likely(tlb_match(e, vpn))) {
+    tlb_hit ++;
+  } else {
+    tlb_miss ++;
+    TLBEntry walk;
+    status = page_walk(vaddr, &walk);
+    if (status != WALK_OK) goto fault;
+    *e = walk;
+  }
+  if (!(e->perm & type_perm[type])) { status = WALK_PAGE_FAULT; goto fault; }
+  return ((paddr_t)e->ppn << PAGE_SHIFT) | MEM_RET_OK;
+
+fault:
+  if (mmu_exception == INTR_EMPTY) {
+    mmu_exception = type_exception[status][type];
+    cpu.csr.mtval = vaddr;
+  }
+  return MEM_RET_FAIL;
+}
+
+// 查到的翻译结果不填入 TLB
+paddr_t isa_mmu_peek(vaddr_t vaddr, int type) {
+  uint32_t vpn = vaddr >> PAGE_SHIFT;
+  TLBEntry walk, *e = tlb_entry(vpn);
+  if (!tlb_match(e, vpn)) {
+    if (page_walk(vaddr, &walk) != WALK_OK) return MEM_RET_FAIL;
+    e = &walk;
+  }
+  if (!(e->perm & type_perm[type])) return MEM_RET_FAIL;
+  return ((paddr_t)e->ppn << PAGE_SHIFT) | MEM_RET_OK;
+}
+
+/* sfence.vma：rs1 为 x0 时作废所有虚拟地址，rs2 为 x0 时作废所有 ASID，否则不作废全局页。
+ * 作废所有虚拟地址时，软件 TLB 和译码缓存不逐项查找，而是让受影响的 ASID 换用新的地址空间编号；
+ * 只作废一页时只作废这一页的表项
+ */
+void mmu_tlb_flush(vaddr_t vaddr, bool all_vaddr, word_t asid, bool all_asid) {
+  for (int i = 0; i < TLB_SIZE; i ++) {
+    TLBEntry *e = &tlb[i];
+    if (!all_vaddr && e->vpn != (vaddr >> PAGE_SHIFT)) continue;
+    if (!all_asid && (e->asid != asid || (e->perm & PTE_G))) continue;
+    e->perm = 0;
+  }
+  if (all_vaddr) {
+    for (int i = 0; i < NR_VM_CTX; i ++) {
+      if (all_asid || SATP_ASID(vm_ctx_tab[i].satp) == asid) vm_ctx_tab[i].id = 0;
+    }
+    mmu_update_ctx();
+    return;
+  }
+  vaddr_t vpage = vaddr & ~(vaddr_t)PAGE_MASK;
+  IFDEF(CONFIG_SOFT_TLB, soft_tlb_flush_page(vpage));
+#ifdef CONFIG_DECODE_CACHE
+  for (int i = 0; i < NR_VM_CTX; i ++) {
+    if (vm_ctx_tab[i].id != 0 && (all_asid || SATP_ASID(vm_ctx_tab[i].satp) == asid)) {
+      isa_decode_cache_flush_page(vpage, vm_ctx_tab[i].id);
+    }
+  }
+#endif
+}
+
+void isa_mmu_flush() {
+  mmu_tlb_flush(0, true, 0, true);
+}
+
+void isa_mmu_statistic() {
+  if (tlb_hit + tlb_miss == 0) return;
+  Log("TLB hit = %" PRIu64 ", miss = %" PRIu64 ", hit rate = %.2f%%", tlb_hit, tlb_miss,
+      100.0 * tlb_hit / (tlb_hit + tlb_miss));
+}
+#else
+paddr_t isa_mmu_translate(vaddr_t vaddr, int len, int type) {
+  return MEM_RET_FAIL;
+}
+
+paddr_t isa_mmu_peek(vaddr_t vaddr, int type) {
   return MEM_RET_FAIL;
 }
+#endif
@@ -71,6 +71,18 @@ void isa_reg_display() {
   // 若需要，也可在此处打印 EFLAGS、段寄存器等
 }
 
+// 返回寄存器在 cpu 中的地址，表达式编译时用它把寄存器名解析成固定的位置；
+// 只有 32 位寄存器和 pc 能以 word_t 的形式取到
+const word_t* isa_reg_str2ptr(const char *s) {
+  if (strcmp(s, "pc") == 0 || strcmp(s, "eip") == 0) return &cpu.pc;
+  for (int i = R_EAX; i <= R_EDI; i ++) {
+    if (strcmp(regsl[i], s) == 0) return &reg_l(i);
+  }
+  return NULL;
+}
+
 word_t isa_reg_str2val(const char *s, bool *success) {
-  return 0;
+  const word_t *p = isa_reg_str2ptr(s);
+  *success = (p != NULL);
+  return p ? *p : 0;
 }
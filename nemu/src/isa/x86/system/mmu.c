@@ -20,3 +20,7 @@
 paddr_t isa_mmu_translate(vaddr_t vaddr, int len, int type) {
   return MEM_RET_FAIL;
 }
+
+paddr_t isa_mmu_peek(vaddr_t vaddr, int type) {
+  return MEM_RET_FAIL;
+}
@@ -18,6 +18,7 @@
 #include <device/mmio.h>
 #include <isa.h>
 #include <cpu/iringbuf.h>
+#include <cpu/tb.h>
 
 #if   defined(CONFIG_PMEM_MALLOC)
 static uint8_t *pmem = NULL;
@@ -25,6 +26,58 @@ static uint8_t *pmem = NULL;
 static uint8_t pmem[CONFIG_MSIZE] PG_ALIGN = {};
 #endif
 
+#ifdef CONFIG_DECODE_CACHE
+// 多出的一项总是 0，JIT 检查写到 pmem 末尾之外的最后一个字节时不会越界
+uint8_t pmem_code_page[(CONFIG_MSIZE >> PAGE_SHIFT) + 1] = {};
+
+void pmem_unmark_code_all(int owner) {
+  for (int i = 0; i < (CONFIG_MSIZE >> PAGE_SHIFT); i ++) {
+    pmem_code_page[i] &= ~owner;
+  }
+}
+
+// guest 改写了曾被执行过的代码页，作废被改写指令的各级缓存
+void pmem_code_write(paddr_t addr, int len) {
+  isa_decode_cache_invalidate(addr, len);
+  IFDEF(CONFIG_JIT, jit_code_write(addr, len));
+}
+#endif
+
+#ifdef CONFIG_WATCHPOINT
+// 多出的一项总是 0，JIT 检查访问的最后一个字节时不会越界
+uint8_t pmem_watch_page[(CONFIG_MSIZE >> PAGE_SHIFT) + 1] = {};
+static bool pmem_watch_used = false;
+
+bool pmem_watch_any() { return pmem_watch_used; }
+
+void pmem_watch_clear() {
+  memset(pmem_watch_page, 0, sizeof(pmem_watch_page));
+  pmem_watch_used = false;
+  IFDEF(CONFIG_SOFT_TLB, soft_tlb_flush());
+  IFDEF(CONFIG_JIT, jit_flush());
+}
+
+void pmem_watch_set(paddr_t addr, word_t len, int flags) {
+  paddr_t last = (addr + len - 1) & ~(paddr_t)PAGE_MASK;
+  for (paddr_t a = addr & ~(paddr_t)PAGE_MASK; ; a += PAGE_SIZE) {
+    if (in_pmem(a)) pmem_watch_page[(a - CONFIG_MBASE) >> PAGE_SHIFT] |= flags;
+    if (a == last) break;
+  }
+  pmem_watch_used = true;
+  // 已经在软件 TLB 中的页要重新经过检查，编译好的本机代码也要重新生成
+  IFDEF(CONFIG_SOFT_TLB, soft_tlb_flush());
+  IFDEF(CONFIG_JIT, jit_flush());
+}
+
+// 写有监视点的页：记下旧值，写入后交给监视点判断是否命中
+static void pmem_watch_write(paddr_t addr, int len, word_t data) {
+  word_t old_val = host_read(guest_to_host(addr), len);
+  host_write(guest_to_host(addr), len, data);
+  IFDEF(CONFIG_DECODE_CACHE, if (unlikely(pmem_is_code(addr, len))) pmem_code_write(addr, len));
+  if (check_data_watchpoints(addr, len, true, old_val, data)) nemu_state.state = NEMU_STOP;
+}
+#endif
+
 uint8_t* guest_to_host(paddr_t paddr) { return pmem + paddr - CONFIG_MBASE; }
 paddr_t host_to_guest(uint8_t *haddr) { return haddr - pmem + CONFIG_MBASE; }
 
@@ -58,6 +111,7 @@ void init_mem() {
   assert(pmem);
 #endif
   IFDEF(CONFIG_MEM_RANDOM, memset(pmem, rand(), CONFIG_MSIZE));
+  IFDEF(CONFIG_SOFT_TLB, soft_tlb_flush());
   Log("physical memory area [" FMT_PADDR ", " FMT_PADDR "]", PMEM_LEFT, PMEM_RIGHT);
 }
 
@@ -75,7 +129,14 @@ word_t paddr_read(paddr_t addr, int len) {
 
 void paddr_write(paddr_t addr, int len, word_t data) {
   if (likely(in_pmem(addr))) {
+#ifdef CONFIG_WATCHPOINT
+    if (unlikely(pmem_watch_flags(addr, len) & PMEM_WATCH_WRITE)) {
+      pmem_watch_write(addr, len, data);
+      return;
+    }
+#endif
     pmem_write(addr, len, data);
+    IFDEF(CONFIG_DECODE_CACHE, if (unlikely(pmem_is_code(addr, len))) pmem_code_write(addr, len));
     return;
   } else {
     // 打印错误信息和指令环形缓冲区
@@ -15,15 +15,220 @@
 
 #include <isa.h>
 #include <memory/paddr.h>
+#include <device/mmio.h>
+#ifdef CONFIG_INST_STAT
+#include <cpu/inststat.h>
+#endif
+#ifdef CONFIG_CACHE_SIM
+#include <cpu/cachesim.h>
+#endif
 
+uint64_t vm_ctx = 0;
+
+/* 把 addr 翻译成物理地址放在 *paddr 中。
+ * 翻译失败时 ISA 已经记下了要抛出的异常，访存不做任何事，返回 false
+ */
+static bool translate(vaddr_t addr, int len, int type, paddr_t *paddr) {
+  switch (isa_mmu_check(addr, len, type)) {
+    case MMU_DIRECT: *paddr = addr; return true;
+    case MMU_TRANSLATE: {
+      paddr_t ret = isa_mmu_translate(addr, len, type);
+      if ((ret & PAGE_MASK) != MEM_RET_OK) return false;
+      *paddr = (ret & ~(paddr_t)PAGE_MASK) | (addr & PAGE_MASK);
+      return true;
+    }
+    default: panic("invalid memory access at vaddr = " FMT_WORD, addr);
+  }
+}
+
+// 与 translate 相同但没有副作用，用于查询刚取过指的物理地址
+bool vaddr_peek(vaddr_t addr, int type, paddr_t *paddr) {
+  switch (isa_mmu_check(addr, 4, type)) {
+    case MMU_DIRECT: *paddr = addr; return true;
+    case MMU_TRANSLATE: {
+      paddr_t ret = isa_mmu_peek(addr, type);
+      if ((ret & PAGE_MASK) != MEM_RET_OK) return false;
+      *paddr = (ret & ~(paddr_t)PAGE_MASK) | (addr & PAGE_MASK);
+      return true;
+    }
+    default: return false;
+  }
+}
+
+#ifdef CONFIG_MTRACE
+static void mtrace(const char *type, vaddr_t addr, paddr_t paddr, int len, word_t data) {
+  log_write("[mtrace] pc = " FMT_WORD ": %s " FMT_WORD " (" FMT_PADDR ") len = %d data = " FMT_WORD "\n",
+      cpu.pc, type, addr, paddr, len, data);
+}
+#endif
+
+// 经过物理地址访问数据，数据监视点、mtrace、缓存模拟和 pmem 的访存统计在这里处理
+static word_t data_read(vaddr_t addr, paddr_t paddr, int len, int type) {
+  word_t ret = paddr_read(paddr, len);
+  if (type == MEM_TYPE_READ) {
+    IFDEF(CONFIG_INST_STAT, if (in_pmem(paddr)) mem_stat_add(&pmem_stat, len, false));
+    IFDEF(CONFIG_CACHE_SIM, if (unlikely(cachesim_active) && in_pmem(paddr)) cachesim_data(paddr, len, false));
+    IFDEF(CONFIG_WATCHPOINT, pmem_watch_read(paddr, len, ret));
+    IFDEF(CONFIG_MTRACE, if (trace_enabled(TRACE_MTRACE)) mtrace("read ", addr, paddr, len, ret));
+  }
+  return ret;
+}
+
+static void data_write(vaddr_t addr, paddr_t paddr, int len, word_t data) {
+  IFDEF(CONFIG_MTRACE, if (trace_enabled(TRACE_MTRACE)) mtrace("write", addr, paddr, len, data));
+  IFDEF(CONFIG_INST_STAT, if (in_pmem(paddr)) mem_stat_add(&pmem_stat, len, true));
+  IFDEF(CONFIG_CACHE_SIM, if (unlikely(cachesim_active) && in_pmem(paddr)) cachesim_data(paddr, len, true));
+  paddr_write(paddr, len, data);
+}
+
+static inline bool cross_page(vaddr_t addr, int len) {
+  return (addr & PAGE_MASK) + len > PAGE_SIZE;
+}
+
+// 跨页访问的两个虚拟页可能映射到不相邻的物理页，开启地址翻译时拆成逐字节访问
+static word_t read_slow(vaddr_t addr, int len, int type) {
+  paddr_t paddr;
+  if (unlikely(cross_page(addr, len)) && isa_mmu_check(addr, len, type) == MMU_TRANSLATE) {
+    word_t ret = 0;
+    for (int i = 0; i < len; i ++) {
+      ret |= read_slow(addr + i, 1, type) << (i * 8);
+    }
+    return ret;
+  }
+  return (translate(addr, len, type, &paddr) ? data_read(addr, paddr, len, type) : 0);
+}
+
+static void write_slow(vaddr_t addr, int len, word_t data) {
+  paddr_t paddr;
+  if (unlikely(cross_page(addr, len)) && isa_mmu_check(addr, len, MEM_TYPE_WRITE) == MMU_TRANSLATE) {
+    // 两页都能写时才写入
+    if (!translate(addr, 1, MEM_TYPE_WRITE, &paddr) ||
+        !translate(addr + len - 1, 1, MEM_TYPE_WRITE, &paddr)) return;
+    for (int i = 0; i < len; i ++) {
+      write_slow(addr + i, 1, data >> (i * 8));
+    }
+    return;
+  }
+  if (translate(addr, len, MEM_TYPE_WRITE, &paddr)) data_write(addr, paddr, len, data);
+}
+
+#ifdef CONFIG_SOFT_TLB
+SoftTLBEntry soft_tlb[3][CONFIG_SOFT_TLB_SIZE];
+
+#ifdef CONFIG_CACHE_SIM
+// 软件 TLB 直接映射的可能是 pmem，也可能是设备的存储空间，只模拟 pmem
+static void cachesim_host(uint8_t *host, int len, bool is_write) {
+  uintptr_t off = host - guest_to_host(CONFIG_MBASE);
+  if (off < CONFIG_MSIZE) cachesim_data(CONFIG_MBASE + off, len, is_write);
+}
+#endif
+
+void soft_tlb_flush() {
+  memset(soft_tlb, 0xff, sizeof(soft_tlb));
+}
+
+// 作废虚拟页 vpage 在所有地址空间中的表项
+void soft_tlb_flush_page(vaddr_t vpage) {
+  for (int type = 0; type < 3; type ++) {
+    SoftTLBEntry *e = soft_tlb_entry(type, vpage);
+    if (((vaddr_t)e->tag & ~(vaddr_t)PAGE_MASK) == vpage) e->tag = (uint64_t)-1;
+  }
+}
+
+// ppage 成为代码页：作废映射到它的写表项，之后对它的写都经过 paddr_write() 中的检查
+void soft_tlb_unmap_write(paddr_t ppage) {
+  uintptr_t host = (uintptr_t)guest_to_host(ppage);
+  for (int i = 0; i < CONFIG_SOFT_TLB_SIZE; i ++) {
+    SoftTLBEntry *e = &soft_tlb[MEM_TYPE_WRITE][i];
+    if (!(e->tag & SOFT_TLB_MMIO) && (vaddr_t)e->tag + e->addend == host) e->tag = (uint64_t)-1;
+  }
+}
+
+static void soft_tlb_fill(SoftTLBEntry *e, vaddr_t vpage, paddr_t ppage, int type) {
+  uint8_t *host = NULL;
+  // mtrace 要看到每一次访存
+  IFDEF(CONFIG_MTRACE, if (trace_enabled(TRACE_MTRACE)) return);
+  if (in_pmem(ppage)) {
+#ifdef CONFIG_DECODE_CACHE
+    // 写代码页时要作废解码缓存，这样的写不能走快速路径
+    if (type == MEM_TYPE_WRITE && pmem_is_code(ppage, 1)) return;
+#endif
+#ifdef CONFIG_WATCHPOINT
+    // 有数据监视点的页要经过 paddr_write() 或读检查
+    int watch = pmem_watch_flags(ppage, 1);
+    if (type == MEM_TYPE_WRITE && (watch & PMEM_WATCH_WRITE)) return;
+    if (type == MEM_TYPE_READ && (watch & PMEM_WATCH_READ)) return;
+#endif
+    host = guest_to_host(ppage);
+  } else {
+#ifdef CONFIG_DEVICE
+    host = mmio_page_host(ppage);
+    if (host == NULL) {
+      e->tag = vm_ctx | vpage | SOFT_TLB_MMIO;
+      e->addend = (uintptr_t)ppage - vpage;
+      return;
+    }
+#else
+    return;
+#endif
+  }
+  e->tag = vm_ctx | vpage;
+  e->addend = (uintptr_t)host - vpage;
+}
+
+/* 软件 TLB 不命中、访问没有对齐或访问 MMIO 页时的慢速路径，必要时填入软件 TLB。
+ * 能直接访问时令 *host 为宿主地址，否则令它为 NULL，物理地址放在 *paddr 中。
+ * 地址翻译失败时返回 false。
+ */
+static bool soft_tlb_lookup(vaddr_t addr, int len, int type, uint8_t **host, paddr_t *paddr) {
+  vaddr_t vpage = addr & ~(vaddr_t)PAGE_MASK;
+  SoftTLBEntry *e = soft_tlb_entry(type, addr);
+  *host = NULL;
+  if (e->tag == (vm_ctx | vpage)) {
+    *host = (uint8_t *)(e->addend + addr);
+  } else if (e->tag == (vm_ctx | vpage | SOFT_TLB_MMIO)) {
+    *paddr = addr + e->addend;
+  } else {
+    if (!translate(addr, len, type, paddr)) return false;
+    soft_tlb_fill(e, vpage, *paddr & ~(paddr_t)PAGE_MASK, type);
+  }
+  return true;
+}
+
+word_t soft_tlb_read(vaddr_t addr, int len, int type) {
+  if (cross_page(addr, len)) return read_slow(addr, len, type);
+  uint8_t *host;
+  paddr_t paddr;
+  if (!soft_tlb_lookup(addr, len, type, &host, &paddr)) return 0;
+  if (host == NULL) return data_read(addr, paddr, len, type);
+  // 命中但没有对齐的访问也是 pmem 访问，和内联的快速路径一样计数
+  IFDEF(CONFIG_INST_STAT, if (type == MEM_TYPE_READ) mem_stat_add(&pmem_stat, len, false));
+  IFDEF(CONFIG_CACHE_SIM, if (unlikely(cachesim_active) && type == MEM_TYPE_READ) cachesim_host(host, len, false));
+  return host_read(host, len);
+}
+
+void soft_tlb_write(vaddr_t addr, int len, word_t data) {
+  if (cross_page(addr, len)) { write_slow(addr, len, data); return; }
+  uint8_t *host;
+  paddr_t paddr;
+  if (!soft_tlb_lookup(addr, len, MEM_TYPE_WRITE, &host, &paddr)) return;
+  if (host != NULL) {
+    IFDEF(CONFIG_INST_STAT, mem_stat_add(&pmem_stat, len, true));
+    IFDEF(CONFIG_CACHE_SIM, if (unlikely(cachesim_active)) cachesim_host(host, len, true));
+    host_write(host, len, data);
+  }
+  else data_write(addr, paddr, len, data);
+}
+#else
 word_t vaddr_ifetch(vaddr_t addr, int len) {
-  return paddr_read(addr, len);
+  return read_slow(addr, len, MEM_TYPE_IFETCH);
 }
 
 word_t vaddr_read(vaddr_t addr, int len) {
-  return paddr_read(addr, len);
+  return read_slow(addr, len, MEM_TYPE_READ);
 }
 
 void vaddr_write(vaddr_t addr, int len, word_t data) {
-  paddr_write(addr, len, data);
+  write_slow(addr, len, data);
 }
+#endif
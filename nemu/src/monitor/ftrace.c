@@ -8,10 +8,44 @@
 #include <string.h>
 // 包含自定义的ftrace功能相关的头文件定义
 #include <monitor/ftrace.h>
+#ifdef CONFIG_CALL_PROFILE
+#include <cpu/callprof.h>
+#endif
 
 // 初始化全局ftrace状态变量，{0}表示所有成员初始化为0或NULL
 FtraceState ftrace_state = {0};
 
+// func_max_end[i] 是 functions[0..i] 中最大的结束地址，用于在函数范围重叠时确定查找的下界
+static uint64_t *func_max_end = NULL;
+
+// 按目标地址索引的查找缓存，同一个调用点反复调用时不必再做二分查找
+#define FUNC_CACHE_SIZE 1024
+typedef struct {
+  uint32_t addr;
+  bool valid;
+  FuncInfo *func;
+} FuncCacheEntry;
+static FuncCacheEntry func_cache[FUNC_CACHE_SIZE];
+
+static int func_cmp(const void *a, const void *b) {
+  const FuncInfo *x = a, *y = b;
+  if (x->addr != y->addr) return x->addr < y->addr ? -1 : 1;
+  return x->elf - y->elf;
+}
+
+// 加载新的符号之后重新排序并建立索引
+static void build_index() {
+  qsort(ftrace_state.functions, ftrace_state.func_count, sizeof(FuncInfo), func_cmp);
+  func_max_end = realloc(func_max_end, sizeof(uint64_t) * (ftrace_state.func_count + 1));
+  uint64_t max_end = 0;
+  for (int i = 0; i < ftrace_state.func_count; i++) {
+    FuncInfo *f = &ftrace_state.functions[i];
+    if ((uint64_t)f->addr + f->size > max_end) max_end = (uint64_t)f->addr + f->size;
+    func_max_end[i] = max_end;
+  }
+  memset(func_cache, 0, sizeof(func_cache));
+}
+
 // 初始化函数追踪功能的函数，参数是ELF文件的路径
 void init_ftrace(const char *elf_file) {
   // 检查ELF文件路径是否为空
@@ -109,13 +143,15 @@ void init_ftrace(const char *elf_file) {
     }
   }
   
-  // 为函数信息数组分配内存
-  ftrace_state.functions = malloc(sizeof(FuncInfo) * func_count);
+  // 扩大函数信息数组，追加在之前加载的符号之后
+  int idx = ftrace_state.func_count;  // 函数信息数组的索引
+  ftrace_state.functions = realloc(ftrace_state.functions, sizeof(FuncInfo) * (idx + func_count));
   // 保存找到的函数数量
-  ftrace_state.func_count = func_count;
+  ftrace_state.func_count = idx + func_count;
+  int elf = ftrace_state.elf_count ++;
+  uint32_t low = UINT32_MAX, high = 0;
   
   // 从符号表中提取函数信息
-  int idx = 0;  // 函数信息数组的索引
   for (int i = 0; i < sym_count; i++) {
     // 再次检查是否是函数符号
     if (ELF32_ST_TYPE(syms[i].st_info) == STT_FUNC) {
@@ -125,10 +161,14 @@ void init_ftrace(const char *elf_file) {
       ftrace_state.functions[idx].addr = syms[i].st_value;
       // 保存函数大小
       ftrace_state.functions[idx].size = syms[i].st_size;
+      ftrace_state.functions[idx].elf = elf;
+      if (syms[i].st_value < low) low = syms[i].st_value;
+      if (syms[i].st_value + syms[i].st_size > high) high = syms[i].st_value + syms[i].st_size;
       idx++;  // 移动到下一个函数信息位置
     }
   }
   
+  build_index();
   // 启用ftrace功能
   ftrace_state.enabled = true;
   // 初始化调用深度为0
@@ -142,41 +182,106 @@ void init_ftrace(const char *elf_file) {
   fclose(fp);         // 关闭ELF文件
   
   // 打印初始化成功信息，显示找到的函数数量
-  printf("Ftrace initialized with %d functions\n", func_count);
+  printf("Ftrace loaded %d functions from %s", func_count, elf_file);
+  if (func_count > 0) printf(" [0x%08x, 0x%08x)", low, high);
+  printf(", %d functions in total\n", ftrace_state.func_count);
+}
+
+// 二分查找起始地址不大于 addr 的最后一个函数，再向前找第一个包含 addr 的函数
+static FuncInfo* lookup_function(uint32_t addr) {
+  int lo = 0, hi = ftrace_state.func_count;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (ftrace_state.functions[mid].addr <= addr) lo = mid + 1;
+    else hi = mid;
+  }
+  // func_max_end 单调不减，一旦不超过 addr，更前面的函数都不可能包含 addr
+  for (int i = lo - 1; i >= 0 && func_max_end[i] > addr; i--) {
+    FuncInfo *func = &ftrace_state.functions[i];
+    // 检查地址是否在函数的地址范围内
+    // 函数范围是从起始地址到起始地址加上函数大小
+    if (addr - func->addr < func->size) return func;
+  }
+  return NULL;  // 没有找到包含该地址的函数，返回NULL
 }
 
 // 根据地址查找对应的函数
 FuncInfo* find_function(uint32_t addr) {
   // 如果ftrace未启用，直接返回NULL
   if (!ftrace_state.enabled) return NULL;
-  
-  // 遍历所有函数，查找包含给定地址的函数
+
+  FuncCacheEntry *e = &func_cache[(addr >> 2) % FUNC_CACHE_SIZE];
+  if (!e->valid || e->addr != addr) {
+    e->addr = addr;
+    e->func = lookup_function(addr);
+    e->valid = true;
+  }
+  return e->func;
+}
+
+// 根据函数名查找函数，用于按函数设置追踪窗口
+FuncInfo* find_function_by_name(const char *name) {
   for (int i = 0; i < ftrace_state.func_count; i++) {
-    FuncInfo *func = &ftrace_state.functions[i];
-    // 检查地址是否在函数的地址范围内
-    // 函数范围是从起始地址到起始地址加上函数大小
-    if (addr >= func->addr && addr < func->addr + func->size) {
-      return func;  // 找到包含该地址的函数，返回函数信息
-    }
+    if (strcmp(ftrace_state.functions[i].name, name) == 0) return &ftrace_state.functions[i];
   }
-  return NULL;  // 没有找到包含该地址的函数，返回NULL
+  return NULL;
+}
+
+int func_nr() {
+  return ftrace_state.enabled ? ftrace_state.func_count : 0;
+}
+
+int func_index(const FuncInfo *f) {
+  return f != NULL ? f - ftrace_state.functions : func_nr();
+}
+
+const char* func_name(int id) {
+  return id < func_nr() ? ftrace_state.functions[id].name : "???";
+}
+
+static uint64_t (*top_key)(int id) = NULL;
+
+static int top_cmp(const void *a, const void *b) {
+  uint64_t x = top_key(*(const int *)a), y = top_key(*(const int *)b);
+  return (x < y) - (x > y);
+}
+
+int func_top(uint64_t (*key)(int id), int *order, int n) {
+  int nr = func_nr() + 1;
+  int *all = malloc(sizeof(int) * nr);
+  assert(all);
+  for (int i = 0; i < nr; i++) all[i] = i;
+  top_key = key;
+  qsort(all, nr, sizeof(int), top_cmp);
+  if (n > nr) n = nr;
+  memcpy(order, all, sizeof(int) * n);
+  free(all);
+  return n;
 }
 
 // 处理函数调用
 void ftrace_call(uint32_t pc, uint32_t target) {
+  IFDEF(CONFIG_CALL_PROFILE, if (callprof_enabled()) callprof_call(target, pc + 4));
+#ifdef CONFIG_TRACE_BINARY
+  // 二进制追踪只记录地址和深度，由 trace-dump 离线符号化
+  if (tracebin_enabled()) { tracebin_call(pc, target); return; }
+#endif
   // 如果ftrace未启用，直接返回
   if (!ftrace_state.enabled) return;
   
   // 查找目标地址对应的函数
   FuncInfo *func = find_function(target);
   if (func) {
+    IFDEF(CONFIG_TRACE, trace_func_call(target, ftrace_state.call_depth));
     // 找到函数，打印调用信息
     // %*s 创建缩进，缩进量等于call_depth * 2个空格
     // 0x%08x 以16进制格式打印PC地址，保证8位宽度
     // %s 打印函数名
-    printf("[call] %*s0x%08x: %s\n", 
-           ftrace_state.call_depth * 2, "", 
-           pc, func->name);
+    if (trace_enabled(TRACE_FTRACE)) {
+      printf("[call] %*s0x%08x: %s\n", 
+             ftrace_state.call_depth * 2, "", 
+             pc, func->name);
+    }
     // 增加调用深度，用于后续输出的缩进
     ftrace_state.call_depth++;
   }
@@ -184,6 +289,10 @@ void ftrace_call(uint32_t pc, uint32_t target) {
 
 // 处理函数返回
 void ftrace_ret(uint32_t pc, uint32_t target) {
+  IFDEF(CONFIG_CALL_PROFILE, if (callprof_enabled()) callprof_ret(target));
+#ifdef CONFIG_TRACE_BINARY
+  if (tracebin_enabled()) { tracebin_ret(pc, target); return; }
+#endif
   // 如果ftrace未启用，直接返回
   if (!ftrace_state.enabled) return;
   
@@ -191,14 +300,18 @@ void ftrace_ret(uint32_t pc, uint32_t target) {
   if (ftrace_state.call_depth > 0) {
     // 减少调用深度，因为正在从一个函数返回
     ftrace_state.call_depth--;
-    // 查找当前PC地址对应的函数
-    FuncInfo *func = find_function(pc);
-    // 打印返回信息
-    // 格式类似调用信息，但使用[ret]标识
-    // 如果找不到函数名，使用"???"表示
-    printf("[ret]  %*s0x%08x: %s\n", 
-           ftrace_state.call_depth * 2, "", 
-           pc, func ? func->name : "???");
+    // 先打印返回信息，再关闭以这个函数为窗口的追踪
+    if (trace_enabled(TRACE_FTRACE)) {
+      // 查找当前PC地址对应的函数
+      FuncInfo *func = find_function(pc);
+      // 打印返回信息
+      // 格式类似调用信息，但使用[ret]标识
+      // 如果找不到函数名，使用"???"表示
+      printf("[ret]  %*s0x%08x: %s\n", 
+             ftrace_state.call_depth * 2, "", 
+             pc, func ? func->name : "???");
+    }
+    IFDEF(CONFIG_TRACE, trace_func_ret(ftrace_state.call_depth));
   }
 }
 
@@ -214,6 +327,11 @@ void cleanup_ftrace() {
   }
   // 释放函数信息数组的内存
   free(ftrace_state.functions);
+  free(func_max_end);
+  ftrace_state.functions = NULL;
+  func_max_end = NULL;
+  ftrace_state.func_count = 0;
+  ftrace_state.elf_count = 0;
   // 标记ftrace为禁用状态
   ftrace_state.enabled = false;
 }
\ No newline at end of file
@@ -46,8 +46,57 @@ void sdb_set_batch_mode();
 static char *log_file = NULL;
 static char *diff_so_file = NULL;
 static char *img_file = NULL;
-static char *elf_file = NULL;
+#define MAX_ELF_FILE 16
+static char *elf_file[MAX_ELF_FILE] = {};
+static int nr_elf_file = 0;
 static int difftest_port = 1234;
+#ifdef CONFIG_SIMPOINT
+#include <cpu/simpoint.h>
+
+static char *bbv_file = NULL;
+static uint64_t bbv_interval = CONFIG_SIMPOINT_INTERVAL;
+#endif
+#ifdef CONFIG_PC_PROFILE
+#include <cpu/pcprof.h>
+
+static char *profile_file = NULL;
+#endif
+#ifdef CONFIG_CALL_PROFILE
+#include <cpu/callprof.h>
+
+static char *callgraph_file = NULL;
+#endif
+#ifdef CONFIG_INST_STAT
+#include <cpu/inststat.h>
+
+static char *stat_file = NULL;
+#endif
+#ifdef CONFIG_CACHE_SIM
+#include <cpu/cachesim.h>
+#endif
+#ifdef CONFIG_BPRED
+#include <cpu/bpred.h>
+#endif
+#ifdef CONFIG_TIMING
+#include <cpu/timing.h>
+#endif
+#ifdef CONFIG_TRACE
+#define MAX_TRACE_SPEC 16
+static char *trace_spec[MAX_TRACE_SPEC] = {};
+static int nr_trace_spec = 0;
+#endif
+#ifdef CONFIG_TRACE_BINARY
+static char *trace_file = NULL;
+#endif
+#ifdef CONFIG_SNAPSHOT
+#include <monitor/snapshot.h>
+
+void sdb_set_save(const char *file, uint64_t n);
+
+static char *restore_file = NULL;
+static char *save_file = NULL;
+static uint64_t save_at = 0;
+#endif
 
 static long load_img() {
   if (img_file == NULL) {
@@ -78,17 +127,94 @@ static int parse_args(int argc, char *argv[]) {
     {"diff"     , required_argument, NULL, 'd'},
     {"port"     , required_argument, NULL, 'p'},
     {"elf"      , required_argument, NULL, 'e'},
+#ifdef CONFIG_SNAPSHOT
+    {"save"     , required_argument, NULL, 's'},
+    {"save-at"  , required_argument, NULL, 'S'},
+    {"restore"  , required_argument, NULL, 'r'},
+#endif
+#ifdef CONFIG_SIMPOINT
+    {"bbv"      , required_argument, NULL, 'B'},
+    {"bbv-interval", required_argument, NULL, 'I'},
+#endif
+#ifdef CONFIG_PC_PROFILE
+    {"profile"  , required_argument, NULL, 'P'},
+#endif
+#ifdef CONFIG_CALL_PROFILE
+    {"callgraph", required_argument, NULL, 'C'},
+#endif
+#ifdef CONFIG_INST_STAT
+    {"stat"     , required_argument, NULL, 'J'},
+#endif
+#ifdef CONFIG_CACHE_SIM
+    {"cache"    , required_argument, NULL, 'c'},
+#endif
+#ifdef CONFIG_BPRED
+    {"bpred"    , required_argument, NULL, 'G'},
+#endif
+#ifdef CONFIG_TIMING
+    {"timing"   , required_argument, NULL, 't'},
+#endif
+#ifdef CONFIG_TRACE
+    {"trace-window", required_argument, NULL, 'W'},
+#endif
+#ifdef CONFIG_TRACE_BINARY
+    {"trace"    , required_argument, NULL, 'T'},
+#endif
     {"help"     , no_argument      , NULL, 'h'},
     {0          , 0                , NULL,  0 },
   };
   int o;
-  while ( (o = getopt_long(argc, argv, "-bhl:d:p:e:", table, NULL)) != -1) {
+  while ( (o = getopt_long(argc, argv, "-bhl:d:p:e:" MUXDEF(CONFIG_SNAPSHOT, "s:S:r:", "")
+      MUXDEF(CONFIG_SIMPOINT, "B:I:", "") MUXDEF(CONFIG_PC_PROFILE, "P:", "")
+      MUXDEF(CONFIG_CALL_PROFILE, "C:", "") MUXDEF(CONFIG_INST_STAT, "J:", "")
+      MUXDEF(CONFIG_CACHE_SIM, "c:", "") MUXDEF(CONFIG_BPRED, "G:", "")
+      MUXDEF(CONFIG_TIMING, "t:", "")
+      MUXDEF(CONFIG_TRACE_BINARY, "T:", "") MUXDEF(CONFIG_TRACE, "W:", ""), table, NULL)) != -1) {
     switch (o) {
       case 'b': sdb_set_batch_mode(); break;
       case 'p': sscanf(optarg, "%d", &difftest_port); break;
       case 'l': log_file = optarg; break;
       case 'd': diff_so_file = optarg; break;
-      case 'e': elf_file = optarg; break;
+      case 'e':
+        if (nr_elf_file < MAX_ELF_FILE) elf_file[nr_elf_file ++] = optarg;
+        else printf("Too many ELF files, ignore '%s'\n", optarg);
+        break;
+#ifdef CONFIG_SNAPSHOT
+      case 's': save_file = optarg; break;
+      case 'S': sscanf(optarg, "%" SCNu64, &save_at); break;
+      case 'r': restore_file = optarg; break;
+#endif
+#ifdef CONFIG_SIMPOINT
+      case 'B': bbv_file = optarg; break;
+      case 'I': sscanf(optarg, "%" SCNu64, &bbv_interval); break;
+#endif
+#ifdef CONFIG_PC_PROFILE
+      case 'P': profile_file = optarg; break;
+#endif
+#ifdef CONFIG_CALL_PROFILE
+      case 'C': callgraph_file = optarg; break;
+#endif
+#ifdef CONFIG_INST_STAT
+      case 'J': stat_file = optarg; break;
+#endif
+#ifdef CONFIG_CACHE_SIM
+      case 'c': if (!cachesim_parse(optarg)) exit(1); break;
+#endif
+#ifdef CONFIG_BPRED
+      case 'G': if (!bpred_parse(optarg)) exit(1); break;
+#endif
+#ifdef CONFIG_TIMING
+      case 't': if (!timing_parse(optarg)) exit(1); break;
+#endif
+#ifdef CONFIG_TRACE
+      case 'W':
+        if (nr_trace_spec < MAX_TRACE_SPEC) trace_spec[nr_trace_spec ++] = optarg;
+        else printf("Too many trace windows, ignore '%s'\n", optarg);
+        break;
+#endif
+#ifdef CONFIG_TRACE_BINARY
+      case 'T': trace_file = optarg; break;
+#endif
       case 1: img_file = optarg; return 0;
       default:
         printf("Usage: %s [OPTION...] IMAGE [args]\n\n", argv[0]);
@@ -96,7 +222,45 @@ static int parse_args(int argc, char *argv[]) {
         printf("\t-l,--log=FILE           output log to FILE\n");
         printf("\t-d,--diff=REF_SO        run DiffTest with reference REF_SO\n");
         printf("\t-p,--port=PORT          run DiffTest with port PORT\n");
-        printf("\t-e,--elf=ELF_FILE       load ELF file\n");
+        printf("\t-e,--elf=ELF_FILE       load symbols from ELF file, can be given more than once\n");
+#ifdef CONFIG_SNAPSHOT
+        printf("\t-s,--save=FILE          save a snapshot to FILE before entering the debugger\n");
+        printf("\t-S,--save-at=N          execute N instructions before saving the snapshot\n");
+        printf("\t-r,--restore=FILE       restore the machine state from snapshot FILE\n");
+#endif
+#ifdef CONFIG_SIMPOINT
+        printf("\t-B,--bbv=FILE           write SimPoint basic block vectors to FILE\n");
+        printf("\t-I,--bbv-interval=N     emit one basic block vector every N instructions\n");
+#endif
+#ifdef CONFIG_PC_PROFILE
+        printf("\t-P,--profile=FILE       count executed instructions per pc, dump the counts to FILE\n");
+#endif
+#ifdef CONFIG_CALL_PROFILE
+        printf("\t-C,--callgraph=FILE     profile instructions by calling context, dump folded stacks to FILE\n");
+#endif
+#ifdef CONFIG_INST_STAT
+        printf("\t-J,--stat=FILE          dump the instruction mix and memory traffic to FILE as JSON\n");
+#endif
+#ifdef CONFIG_CACHE_SIM
+        printf("\t-c,--cache=SPEC         simulate caches, can be given more than once;\n");
+        printf("\t                        SPEC is l1i|l1d|l2:SIZE:WAYS:LINE[:lru|fifo|random] or sample:INTERVAL:LENGTH\n");
+#endif
+#ifdef CONFIG_BPRED
+        printf("\t-G,--bpred=SPEC         simulate branch prediction, can be given more than once;\n");
+        printf("\t                        SPEC is static|bimodal|gshare|tage[:BITS], btb:ENTRIES or ras:DEPTH\n");
+#endif
+#ifdef CONFIG_TIMING
+        printf("\t-t,--timing=SPEC        estimate cycles with a 5-stage pipeline model;\n");
+        printf("\t                        SPEC is on or NAME=CYCLES,... to change the latencies\n");
+#endif
+#ifdef CONFIG_TRACE
+        printf("\t-W,--trace-window=SPEC  control itrace/ftrace/mtrace at runtime, can be given more than once;\n");
+        printf("\t                        SPEC is \"KINDS inst START END\", \"KINDS pc LO HI\",\n");
+        printf("\t                        \"KINDS func NAME\" or \"on|off KINDS\", and replaces the defaults\n");
+#endif
+#ifdef CONFIG_TRACE_BINARY
+        printf("\t-T,--trace=FILE         write a binary instruction and function trace to FILE\n");
+#endif
         printf("\n");
         exit(0);
     }
@@ -110,11 +274,19 @@ void init_monitor(int argc, char *argv[]) {
   /* Parse arguments. */
   parse_args(argc, argv);
 
-  /* Initialize ftrace. */
-  extern char *elf_file;  // 来自parse_args函数中定义的变量
-  if (elf_file != NULL) {
-    init_ftrace(elf_file);
+  /* Initialize ftrace. Symbols of all ELF files given by -e are loaded. */
+  for (int i = 0; i < nr_elf_file; i ++) {
+    init_ftrace(elf_file[i]);
+  }
+
+#ifdef CONFIG_TRACE
+  /* Initialize trace windows. Windows given by -W replace the default settings. */
+  init_trace();
+  if (nr_trace_spec > 0) trace_clear();
+  for (int i = 0; i < nr_trace_spec; i ++) {
+    if (!trace_command(trace_spec[i])) exit(1);
   }
+#endif
 
   /* Set random seed. */
   init_rand();
@@ -137,8 +309,22 @@ void init_monitor(int argc, char *argv[]) {
   /* Initialize differential testing. */
   init_difftest(diff_so_file, img_size, difftest_port);
 
+#ifdef CONFIG_SNAPSHOT
+  /* Restore the machine state from a snapshot. */
+  if (restore_file != NULL && !snapshot_load(restore_file)) exit(1);
+#endif
+
   /* Initialize the simple debugger. */
   init_sdb();
+  IFDEF(CONFIG_SNAPSHOT, if (save_file != NULL) sdb_set_save(save_file, save_at));
+  IFDEF(CONFIG_SIMPOINT, if (bbv_file != NULL) init_simpoint(bbv_file, bbv_interval));
+  IFDEF(CONFIG_PC_PROFILE, if (profile_file != NULL) init_pcprof(profile_file));
+  IFDEF(CONFIG_CALL_PROFILE, if (callgraph_file != NULL) init_callprof(callgraph_file));
+  IFDEF(CONFIG_INST_STAT, if (stat_file != NULL) init_inststat(stat_file));
+  IFDEF(CONFIG_CACHE_SIM, init_cachesim());
+  IFDEF(CONFIG_BPRED, init_bpred());
+  IFDEF(CONFIG_TIMING, init_timing());
+  IFDEF(CONFIG_TRACE_BINARY, if (trace_file != NULL) init_tracebin(trace_file));
 
   IFDEF(CONFIG_ITRACE, init_disasm());
 
@@ -0,0 +1,191 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include "sdb.h"
+#include <cpu/tb.h>
+
+/* 断点按 pc 检查。pmem 范围内每个可能的指令地址在 bp_map 中占一位，
+ * 执行循环对没有断点的 pc 只做一次位测试；范围之外的断点很少见，查链表。
+ * 条件、命中计数和临时断点都在命中之后的慢速路径 bp_hit() 中处理。
+ */
+typedef struct breakpoint {
+  int NO;
+  vaddr_t pc;
+  char *cond_str;     // 条件表达式，没有条件时为 NULL
+  Expr *cond;
+  bool temp;          // 临时断点，第一次停下后删除
+  uint64_t hit;       // 命中次数
+  uint64_t ignore;    // 还要忽略的命中次数
+  int trace_kind;     // 命中时打开的追踪种类
+  struct breakpoint *next;
+} BP;
+
+static BP *head = NULL;
+static int next_no = 1;
+
+uint8_t *bp_map = NULL;
+int nr_bp = 0;
+int nr_bp_far = 0;
+
+static inline bool bp_in_map(vaddr_t pc) {
+  return pc - CONFIG_MBASE < CONFIG_MSIZE;
+}
+
+static inline void bp_map_set(vaddr_t pc, bool set) {
+  word_t off = (pc - CONFIG_MBASE) >> BP_SHIFT;
+  if (set) bp_map[off >> 3] |= 1 << (off & 7);
+  else bp_map[off >> 3] &= ~(1 << (off & 7));
+}
+
+static BP* find_bp(int NO) {
+  for (BP *p = head; p != NULL; p = p->next) {
+    if (p->NO == NO) return p;
+  }
+  return NULL;
+}
+
+// 同一个 pc 上可能有多个断点，删除一个之后要看是否还有别的
+static bool pc_has_bp(vaddr_t pc) {
+  for (BP *p = head; p != NULL; p = p->next) {
+    if (p->pc == pc) return true;
+  }
+  return false;
+}
+
+int new_bp(vaddr_t pc, char *cond_str, bool temp) {
+  Expr *cond = NULL;
+  if (cond_str != NULL) {
+    bool success = true;
+    cond = expr_compile(cond_str, &success);
+    if (!success) {
+      printf("Bad condition '%s'\n", cond_str);
+      return -1;
+    }
+  }
+
+  if (bp_map == NULL) {
+    // 按需分配，没有断点的页不会占用宿主内存
+    bp_map = calloc(((CONFIG_MSIZE >> BP_SHIFT) + 7) / 8, 1);
+    assert(bp_map);
+  }
+
+  BP *bp = malloc(sizeof(BP));
+  bp->NO = next_no ++;
+  bp->pc = pc;
+  bp->cond_str = (cond_str != NULL ? strdup(cond_str) : NULL);
+  bp->cond = cond;
+  bp->temp = temp;
+  bp->hit = 0;
+  bp->ignore = 0;
+  bp->trace_kind = 0;
+  bp->next = NULL;
+  // 按编号顺序排列
+  BP **pp = &head;
+  while (*pp != NULL) pp = &(*pp)->next;
+  *pp = bp;
+
+  if (bp_in_map(pc)) bp_map_set(pc, true);
+  else nr_bp_far ++;
+  nr_bp ++;
+  // 已经构造的基本块可能跨过了新断点，要重新构造
+  IFDEF(CONFIG_ENGINE_THREADED, MUXDEF(CONFIG_JIT, jit_flush(), tb_flush()));
+  return bp->NO;
+}
+
+bool free_bp(int NO) {
+  BP **pp = &head;
+  while (*pp != NULL && (*pp)->NO != NO) pp = &(*pp)->next;
+  BP *bp = *pp;
+  if (bp == NULL) return false;
+  *pp = bp->next;
+
+  if (bp_in_map(bp->pc)) {
+    if (!pc_has_bp(bp->pc)) bp_map_set(bp->pc, false);
+  } else nr_bp_far --;
+  nr_bp --;
+
+  free(bp->cond_str);
+  expr_free(bp->cond);
+  free(bp);
+  return true;
+}
+
+bool set_bp_ignore(int NO, uint64_t count) {
+  BP *bp = find_bp(NO);
+  if (bp == NULL) return false;
+  bp->ignore = count;
+  return true;
+}
+
+bool set_bp_trace(int NO, int kind) {
+  BP *bp = find_bp(NO);
+  if (bp == NULL) return false;
+  bp->trace_kind = kind;
+  return true;
+}
+
+void list_breakpoints() {
+  if (head == NULL) {
+    printf("No breakpoints\n");
+    return;
+  }
+
+  printf("Num\tType\tAddress\t\tHits\tCondition\n");
+  for (BP *p = head; p != NULL; p = p->next) {
+    printf("%d\t%s\t" FMT_WORD "\t%" PRIu64 "\t%s", p->NO, (p->temp ? "temp" : "keep"),
+        p->pc, p->hit, (p->cond_str ? p->cond_str : ""));
+    if (p->ignore > 0) printf("\t(ignore next %" PRIu64 " hits)", p->ignore);
+#ifdef CONFIG_TRACE
+    if (p->trace_kind) {
+      printf("\t(trace on:%s%s%s)", (p->trace_kind & TRACE_ITRACE ? " itrace" : ""),
+          (p->trace_kind & TRACE_FTRACE ? " ftrace" : ""), (p->trace_kind & TRACE_MTRACE ? " mtrace" : ""));
+    }
+#endif
+    printf("\n");
+  }
+}
+
+/* 将要执行的指令的 pc 上有断点时调用，返回是否要停下。
+ * 条件不成立的命中不计数；被忽略的命中计数但不停下，仍然会打开追踪。
+ */
+bool bp_hit(vaddr_t pc) {
+  bool stop = false;
+  BP *p = head;
+  while (p != NULL) {
+    BP *next = p->next;
+    if (p->pc == pc) {
+      bool success = true;
+      bool cond = (p->cond == NULL || expr_eval(p->cond, &success) != 0);
+      if (!success) {
+        printf("Error: Failed to evaluate breakpoint condition '%s'\n", p->cond_str);
+        cond = true;
+      }
+      if (cond) {
+        p->hit ++;
+        IFDEF(CONFIG_TRACE, if (p->trace_kind) trace_set(p->trace_kind, true));
+        if (p->ignore > 0) p->ignore --;
+        else {
+          printf("Breakpoint %d at " FMT_WORD ", hit %" PRIu64 " time%s\n",
+              p->NO, pc, p->hit, (p->hit > 1 ? "s" : ""));
+          stop = true;
+          if (p->temp) free_bp(p->NO);
+        }
+      }
+    }
+    p = next;
+  }
+  return stop;
+}
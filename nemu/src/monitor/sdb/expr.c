@@ -24,16 +24,7 @@
 // 包含通用功能和定义的头文件
 #include "common.h"
 #include <memory/paddr.h>
-
-//得到寄存器值函数，主要用于封装isa_reg_str2val
-static word_t get_register_value(const char *reg_name) {
-  bool success = true;
-  word_t val = isa_reg_str2val(reg_name, &success);
-  if (!success) {
-    printf("Invalid register name: %s\n", reg_name);
-  }
-  return val;
-}
+#include "sdb.h"
 
 // 定义token类型的枚举
 enum {
@@ -101,11 +92,23 @@ typedef struct token {
   char str[32];  // token字符串内容，主要用于存储数字值
 } Token;
 
-// 存储所有解析出的tokens，最多32个
-static Token tokens[32] __attribute__((used)) = {};
+// 存储所有解析出的tokens，数组按需扩展，表达式长度不受限制
+static Token *tokens = NULL;
+// tokens数组的容量
+static int tokens_cap = 0;
 // tokens数组中有效token的数量
 static int nr_token __attribute__((used))  = 0;
 
+// 取得下一个可写的token，必要时扩展数组
+static Token* next_token() {
+  if (nr_token == tokens_cap) {
+    tokens_cap = (tokens_cap == 0 ? 32 : tokens_cap * 2);
+    tokens = realloc(tokens, sizeof(Token) * tokens_cap);
+    assert(tokens);
+  }
+  return &tokens[nr_token];
+}
+
 /* 利用正则匹配将表达式拆分成若干 token */
 static bool make_token(char *e) {
   int position = 0;     // 当前处理位置
@@ -123,6 +126,7 @@ static bool make_token(char *e) {
         int substr_len = pmatch.rm_eo;      // 子字符串长度
         position += substr_len;             // 更新处理位置
         matched = true;                     // 标记为匹配成功
+        next_token();                       // 保证tokens[nr_token]可写
 
         // 根据匹配到的token类型进行处理
         switch (rules[i].token_type) {
@@ -180,17 +184,6 @@ static bool make_token(char *e) {
         break;  // 匹配成功后退出内层循环
       }
     }
-    //识别指针解引用运算符
-    for (int i = 0; i < nr_token; i++) {
-      if (tokens[i].type == '*' && (i == 0 || (
-          tokens[i-1].type != TK_NUM && 
-          tokens[i-1].type != TK_HEX && 
-          tokens[i-1].type != TK_REG && 
-          tokens[i-1].type != ')'))) {
-        // 将一元*标记为解引用
-        tokens[i].type = TK_DEREF;
-      }
-    }
     if (!matched) {  // 如果没有任何规则匹配成功
       // 输出错误信息，显示无法匹配的位置
       printf("no match at position %d\n%s\n%*.s^\n", position, e, position, "");
@@ -198,6 +191,18 @@ static bool make_token(char *e) {
     }
   }
 
+  //识别指针解引用运算符
+  for (int i = 0; i < nr_token; i++) {
+    if (tokens[i].type == '*' && (i == 0 || (
+        tokens[i-1].type != TK_NUM && 
+        tokens[i-1].type != TK_HEX && 
+        tokens[i-1].type != TK_REG && 
+        tokens[i-1].type != ')'))) {
+      // 将一元*标记为解引用
+      tokens[i].type = TK_DEREF;
+    }
+  }
+
   return true;  // 所有字符都成功解析，返回成功
 }
 
@@ -219,46 +224,85 @@ static bool check_parentheses(int p, int q) {
   return false;  // 不是以左括号开始和右括号结束
 }
 
-/* 递归求值函数，计算从p到q的表达式值 */
-static word_t eval(int p, int q, bool *success) {
-  // 如果p > q，表示表达式无效
-  if (p > q) {
-    *success = false;  // 设置失败标志
-    return 0;
+/* 表达式只在设置时解析一次，编译成后缀形式的栈式字节码；
+ * 寄存器名在编译时解析成 cpu 中的位置，之后每次求值只需顺序执行字节码。
+ */
+enum { OP_IMM, OP_REG, OP_DEREF, OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_EQ, OP_NEQ, OP_AND };
+
+typedef struct {
+  int type;
+  union {
+    word_t imm;          // OP_IMM 的立即数
+    const word_t *reg;   // OP_REG 对应寄存器的位置
+  };
+} ExprOp;
+
+struct Expr {
+  ExprOp *code;
+  int nr_code;
+  word_t *stack;   // 求值栈，大小为编译时算出的最大深度
+};
+
+// 编译过程中的字节码缓冲区
+static ExprOp *code = NULL;
+static int code_cap = 0;
+static int nr_code = 0;
+static int cur_depth = 0, max_depth = 0;
+
+static ExprOp* emit(int type) {
+  if (nr_code == code_cap) {
+    code_cap = (code_cap == 0 ? 32 : code_cap * 2);
+    code = realloc(code, sizeof(ExprOp) * code_cap);
+    assert(code);
   }
+  // 维护求值栈的深度：取操作数入栈，二元运算出栈两个再入栈一个
+  if (type == OP_IMM || type == OP_REG) cur_depth ++;
+  else if (type != OP_DEREF) cur_depth --;
+  if (cur_depth > max_depth) max_depth = cur_depth;
+  ExprOp *op = &code[nr_code ++];
+  op->type = type;
+  return op;
+}
+
+/* 递归编译函数，为从p到q的表达式生成字节码 */
+static bool compile(int p, int q) {
+  // 如果p > q，表示表达式无效
+  if (p > q) return false;
   
-  // 如果只有一个token，直接返回其值
+  // 如果只有一个token，生成取操作数的指令
   if (p == q) {
     if (tokens[p].type == TK_NUM) {
-      return strtoul(tokens[p].str, NULL, 10);
+      emit(OP_IMM)->imm = strtoul(tokens[p].str, NULL, 10);
+      return true;
     }
     else if (tokens[p].type == TK_HEX) {
       // 处理十六进制，跳过"0x"前缀
-      return strtoul(tokens[p].str, NULL, 16);
+      emit(OP_IMM)->imm = strtoul(tokens[p].str, NULL, 16);
+      return true;
     }
     else if (tokens[p].type == TK_REG) {
-      // 获取寄存器值的函数(需要实现)
-      return get_register_value(tokens[p].str + 1);
-    }
-    else {
-      *success = false;
-      return 0;
+      const word_t *reg = isa_reg_str2ptr(tokens[p].str + 1);
+      if (reg == NULL) {
+        printf("Invalid register name: %s\n", tokens[p].str + 1);
+        return false;
+      }
+      emit(OP_REG)->reg = reg;
+      return true;
     }
+    return false;
   }
   
   // 处理解引用运算符
-  if (tokens[p].type == TK_DEREF && p < q) {
-    // 计算解引用的操作数
-    word_t addr = eval(p + 1, q, success);
-    if (!*success) return 0;
-    
-    // 读取内存中的值
-    return paddr_read(addr, 4);  // 假设读取4字节，根据实际需要调整
+  if (tokens[p].type == TK_DEREF) {
+    // 先计算解引用的操作数
+    if (!compile(p + 1, q)) return false;
+    emit(OP_DEREF);
+    return true;
   }
 
-  // 如果表达式被一对括号完整包围，去除这对括号，递归求值
+  // 如果表达式被一对括号完整包围，去除这对括号，递归编译
   if (check_parentheses(p, q)) {
-    return eval(p + 1, q - 1, success);
+    return compile(p + 1, q - 1);
   }
 
   // 寻找主运算符(最后被计算的运算符)
@@ -293,47 +337,93 @@ static word_t eval(int p, int q, bool *success) {
   }
 
   // 如果没有找到合适的运算符
-  if (op == -1) {
-    *success = false;  // 设置失败标志
-    return 0;
-  }
+  if (op == -1) return false;
 
-  // 递归计算左边表达式的值
-  word_t val1 = eval(p, op - 1, success);
-  if (!*success) return 0;  // 如果左表达式计算失败，直接返回
-  
-  // 递归计算右边表达式的值
-  word_t val2 = eval(op + 1, q, success);
-  if (!*success) return 0;  // 如果右表达式计算失败，直接返回
+  // 先为左右两边的表达式生成字节码，再生成运算指令
+  if (!compile(p, op - 1)) return false;
+  if (!compile(op + 1, q)) return false;
 
-  // 根据运算符类型计算结果
   switch (tokens[op].type) {
-    case '+': return val1 + val2;  // 加法
-    case '-': return val1 - val2;  // 减法
-    case '*': return val1 * val2;  // 乘法
-    case '/':
-      {if (val2 == 0) {  // 检查除数是否为0
-        *success = false;  // 除数为0，设置失败标志
-        return 0;
-      }
-      return val1 / val2;  // 除法
+    case '+': emit(OP_ADD); break;
+    case '-': emit(OP_SUB); break;
+    case '*': emit(OP_MUL); break;
+    case '/': emit(OP_DIV); break;
+    case TK_EQ: emit(OP_EQ); break;
+    case TK_NEQ: emit(OP_NEQ); break;
+    case TK_AND: emit(OP_AND); break;
+    default: return false;
+  }
+  return true;
+}
+
+/* 把表达式编译成字节码，失败时返回NULL */
+Expr* expr_compile(char *e, bool *success) {
+  *success = false;
+  // 先进行词法分析，将表达式切分为token
+  if (!make_token(e)) return NULL;
+
+  nr_code = 0;
+  cur_depth = max_depth = 0;
+  if (!compile(0, nr_token - 1)) return NULL;
+  assert(cur_depth == 1);
+
+  Expr *ex = malloc(sizeof(Expr));
+  ex->nr_code = nr_code;
+  ex->code = malloc(sizeof(ExprOp) * nr_code);
+  memcpy(ex->code, code, sizeof(ExprOp) * nr_code);
+  ex->stack = malloc(sizeof(word_t) * max_depth);
+  *success = true;
+  return ex;
+}
+
+/* 执行编译好的字节码，求出表达式的当前值 */
+word_t expr_eval(Expr *ex, bool *success) {
+  word_t *sp = ex->stack;  // 指向栈顶的下一个位置
+  ExprOp *end = ex->code + ex->nr_code;
+  for (ExprOp *op = ex->code; op < end; op ++) {
+    switch (op->type) {
+      case OP_IMM: *sp ++ = op->imm; break;
+      case OP_REG: *sp ++ = *op->reg; break;
+      case OP_DEREF: sp[-1] = paddr_read(sp[-1], 4); break;  // 假设读取4字节
+      default: {
+        word_t val2 = *(-- sp);
+        word_t val1 = sp[-1];
+        switch (op->type) {
+          case OP_ADD: val1 = val1 + val2; break;
+          case OP_SUB: val1 = val1 - val2; break;
+          case OP_MUL: val1 = val1 * val2; break;
+          case OP_DIV:
+            if (val2 == 0) {  // 除数为0，求值失败
+              *success = false;
+              return 0;
+            }
+            val1 = val1 / val2;
+            break;
+          case OP_EQ: val1 = (val1 == val2); break;
+          case OP_NEQ: val1 = (val1 != val2); break;
+          case OP_AND: val1 = (val1 && val2); break;
+          default: panic("bad expression opcode %d", op->type);
+        }
+        sp[-1] = val1;
       }
-    case TK_EQ: return val1 == val2;  // 相等比较
-    case TK_NEQ: return val1 != val2;  // 不等比较
-    case TK_AND: return val1 && val2;  // 逻辑与
-    default: 
-      *success = false;  // 设置失败标志
-      return 0;
+    }
   }
+  *success = true;
+  return ex->stack[0];
+}
+
+void expr_free(Expr *ex) {
+  if (ex == NULL) return;
+  free(ex->code);
+  free(ex->stack);
+  free(ex);
 }
 
 /* 外部使用的表达式求值接口 */
 word_t expr(char *e, bool *success) {
-  // 先进行词法分析，将表达式切分为token
-  if (!make_token(e)) {
-    *success = false;  // 词法分析失败，设置失败标志
-    return 0;
-  }
-  // 调用递归求值函数，计算整个表达式的值
-  return eval(0, nr_token - 1, success);
+  Expr *ex = expr_compile(e, success);
+  if (ex == NULL) return 0;
+  word_t val = expr_eval(ex, success);
+  expr_free(ex);
+  return val;
 }
@@ -20,6 +20,9 @@
 #include "sdb.h"
 #include <memory/paddr.h>
 #include <cpu/iringbuf.h>
+#ifdef CONFIG_SNAPSHOT
+#include <monitor/snapshot.h>
+#endif
 
 static int is_batch_mode = false;
 
@@ -74,6 +77,9 @@ static int cmd_info(char *args) {
   } else if (args[0] == 'w') {
     // 显示监视点信息
     list_watchpoints();
+  } else if (args[0] == 'b') {
+    // 显示断点信息
+    IFDEF(CONFIG_BREAKPOINT, list_breakpoints());
   } else {
     printf("Unknown info command: '%s'\n", args);
   }
@@ -129,21 +135,25 @@ static int cmd_w(char *args) {
   }
   
   bool success = true;
-  uint32_t val = expr(args, &success);
+  // 表达式只在这里解析一次，之后每条指令执行后直接求值
+  Expr *code = expr_compile(args, &success);
+  uint32_t val = (success ? expr_eval(code, &success) : 0);
   
   if (!success) {
     printf("Failed to evaluate expression '%s'\n", args);
+    expr_free(code);
     return 0;
   }
   
   WP *wp = new_wp();
   if (wp == NULL) {
     printf("Failed to create watchpoint\n");
+    expr_free(code);
     return 0;
   }
   
-  strncpy(wp->expr, args, sizeof(wp->expr) - 1);
-  wp->expr[sizeof(wp->expr) - 1] = '\0'; // 确保字符串结束
+  wp->expr = strdup(args);
+  wp->code = code;
   wp->old_val = val;
   
   printf("Watchpoint %d: %s\n", wp->NO, wp->expr);
@@ -151,6 +161,128 @@ static int cmd_w(char *args) {
   return 0;
 }
 
+#ifdef CONFIG_WATCHPOINT
+// 设置数据监视点：监视物理地址范围上的写、读或任意访问
+static int cmd_watch(char *args) {
+  char *flag = strtok(NULL, " ");
+  char *addr_str = strtok(NULL, " ");
+  char *len_str = strtok(NULL, " ");
+  int type = -1;
+  if (flag != NULL) {
+    if (strcmp(flag, "-w") == 0) type = WP_WRITE;
+    else if (strcmp(flag, "-r") == 0) type = WP_READ;
+    else if (strcmp(flag, "-a") == 0) type = WP_ACCESS;
+  }
+  if (type < 0 || addr_str == NULL) {
+    printf("Usage: watch -w|-r|-a ADDR [LEN]\n");
+    return 0;
+  }
+
+  bool success = true;
+  paddr_t addr = expr(addr_str, &success);
+  if (!success) {
+    printf("Bad address '%s'\n", addr_str);
+    return 0;
+  }
+  word_t len = (len_str != NULL ? strtoul(len_str, NULL, 0) : 4);
+  if (len == 0 || !in_pmem(addr) || !in_pmem(addr + len - 1) || addr + len - 1 < addr) {
+    printf("[" FMT_PADDR ", +%" PRIu64 ") is not in pmem\n", addr, (uint64_t)len);
+    return 0;
+  }
+
+  WP *wp = new_data_wp(type, addr, len);
+  printf("Watchpoint %d: %s [" FMT_PADDR ", +%" PRIu64 ")\n", wp->NO,
+      (type == WP_WRITE ? "write" : type == WP_READ ? "read" : "access"), addr, (uint64_t)len);
+  return 0;
+}
+#endif
+
+#ifdef CONFIG_BREAKPOINT
+// 设置断点：ADDR 是表达式，可以带 "if COND" 条件
+static int set_breakpoint(char *args, bool temp) {
+  if (args == NULL) {
+    printf("Usage: %s ADDR [if COND]\n", (temp ? "tb" : "b"));
+    return 0;
+  }
+  char *cond = NULL;
+  char *p = strstr(args, " if ");
+  if (p != NULL) {
+    *p = '\0';
+    cond = p + 4;
+  }
+
+  bool success = true;
+  vaddr_t pc = expr(args, &success);
+  if (!success) {
+    printf("Bad address '%s'\n", args);
+    return 0;
+  }
+  int no = new_bp(pc, cond, temp);
+  if (no >= 0) {
+    printf("%s %d at " FMT_WORD "%s%s\n", (temp ? "Temporary breakpoint" : "Breakpoint"),
+        no, pc, (cond ? " if " : ""), (cond ? cond : ""));
+  }
+  return 0;
+}
+
+static int cmd_b(char *args) {
+  return set_breakpoint(args, false);
+}
+
+static int cmd_tb(char *args) {
+  return set_breakpoint(args, true);
+}
+
+// 删除断点
+static int cmd_bd(char *args) {
+  char *endptr;
+  int no = (args ? strtol(args, &endptr, 10) : 0);
+  if (args == NULL || *endptr != '\0') {
+    printf("Usage: bd N\n");
+    return 0;
+  }
+  if (free_bp(no)) printf("Deleted breakpoint %d\n", no);
+  else printf("Breakpoint %d not found\n", no);
+  return 0;
+}
+
+// 接下来 COUNT 次命中断点时不停下
+static int cmd_ignore(char *args) {
+  char *no_str = strtok(NULL, " ");
+  char *count_str = strtok(NULL, " ");
+  if (no_str == NULL || count_str == NULL) {
+    printf("Usage: ignore N COUNT\n");
+    return 0;
+  }
+  int no = atoi(no_str);
+  uint64_t count = strtoull(count_str, NULL, 0);
+  if (set_bp_ignore(no, count)) printf("Will ignore next %" PRIu64 " hits of breakpoint %d\n", count, no);
+  else printf("Breakpoint %d not found\n", no);
+  return 0;
+}
+#endif
+
+#ifdef CONFIG_TRACE
+/* 运行时控制追踪，参数见 trace_command()。
+ * "trace KINDS bp N" 让断点 N 命中时打开追踪，配合 ignore 可以只打开追踪而不停下。
+ */
+static int cmd_trace(char *args) {
+#ifdef CONFIG_BREAKPOINT
+  char kinds[64];
+  int no;
+  if (args != NULL && sscanf(args, "%63s bp %d", kinds, &no) == 2) {
+    int kind = trace_parse_kind(kinds);
+    if (kind < 0) return 0;
+    if (set_bp_trace(no, kind)) printf("Breakpoint %d turns on %s\n", no, kinds);
+    else printf("Breakpoint %d not found\n", no);
+    return 0;
+  }
+#endif
+  trace_command(args);
+  return 0;
+}
+#endif
+
 // 删除监视点
 static int cmd_d(char *args) {
   if (args == NULL) {
@@ -206,6 +338,26 @@ static int cmd_si(char *args) {
   return 0;
 }
 
+#ifdef CONFIG_SNAPSHOT
+static int cmd_save(char *args) {
+  if (args == NULL) {
+    printf("Usage: save FILE\n");
+    return 0;
+  }
+  snapshot_save(args);
+  return 0;
+}
+
+static int cmd_load(char *args) {
+  if (args == NULL) {
+    printf("Usage: load FILE\n");
+    return 0;
+  }
+  snapshot_load(args);
+  return 0;
+}
+#endif
+
 static struct {
   const char *name;
   const char *description;
@@ -215,13 +367,30 @@ static struct {
     {"c", "Continue the execution of the program", cmd_c},
     {"q", "Exit NEMU", cmd_q},
     {"n", "Execute the next instruction", cmd_n},
-    {"info", "Print the information of registers or watchpoints", cmd_info},
+    {"info", "Print the information of registers, watchpoints or breakpoints. Usage: info r|w|b", cmd_info},
     {"x", "Scan memory. Usage: x N EXPR", cmd_x},
     {"p", "Evaluate expression. Usage: p EXPR", cmd_p},
     {"w", "Set a watchpoint. Usage: w EXPR", cmd_w},
+#ifdef CONFIG_WATCHPOINT
+    {"watch", "Watch writes (-w), reads (-r) or both (-a) to physical memory. Usage: watch -w|-r|-a ADDR [LEN]", cmd_watch},
+#endif
     {"d", "Delete a watchpoint. Usage: d N", cmd_d},
+#ifdef CONFIG_BREAKPOINT
+    {"b", "Set a breakpoint. Usage: b ADDR [if COND]", cmd_b},
+    {"tb", "Set a temporary breakpoint, deleted when hit. Usage: tb ADDR [if COND]", cmd_tb},
+    {"bd", "Delete a breakpoint. Usage: bd N", cmd_bd},
+    {"ignore", "Do not stop at the next COUNT hits of a breakpoint. Usage: ignore N COUNT", cmd_ignore},
+#endif
     {"iringbuf", "Display recently executed instructions", cmd_iringbuf},
     {"si", "Execute N instructions step by step. Usage: si [N]", cmd_si},
+#ifdef CONFIG_TRACE
+    {"trace", "Control itrace/ftrace/mtrace. Usage: trace [clear | on|off KINDS | KINDS inst START END | "
+              "KINDS pc LO HI | KINDS func NAME | KINDS bp N]", cmd_trace},
+#endif
+#ifdef CONFIG_SNAPSHOT
+    {"save", "Save the machine state to a snapshot file. Usage: save FILE", cmd_save},
+    {"load", "Restore the machine state from a snapshot file. Usage: load FILE", cmd_load},
+#endif
 
     /* TODO: Add more commands */
 
@@ -256,7 +425,26 @@ void sdb_set_batch_mode() {
   is_batch_mode = true;
 }
 
+#ifdef CONFIG_SNAPSHOT
+static const char *save_file = NULL;
+static uint64_t save_at = 0;
+
+// 进入调试器之前先执行 n 条指令，然后保存快照
+void sdb_set_save(const char *file, uint64_t n) {
+  save_file = file;
+  save_at = n;
+}
+#endif
+
 void sdb_mainloop() {
+#ifdef CONFIG_SNAPSHOT
+  if (save_file != NULL) {
+    if (save_at > 0) cpu_exec(save_at);
+    if (nemu_state.state == NEMU_RUNNING || nemu_state.state == NEMU_STOP) snapshot_save(save_file);
+    else printf("The program has finished before saving the snapshot\n");
+  }
+#endif
+
   if (is_batch_mode) {
     cmd_c(NULL);
     return;
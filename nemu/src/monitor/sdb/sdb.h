@@ -17,24 +17,48 @@
 #define __SDB_H__
 
 #include <common.h>
+#include <monitor/breakpoint.h>
 
 word_t expr(char *e, bool *success);
 
+// 编译后的表达式，设置监视点时编译一次，之后反复求值
+typedef struct Expr Expr;
+Expr* expr_compile(char *e, bool *success);
+word_t expr_eval(Expr *ex, bool *success);
+void expr_free(Expr *ex);
+
+// 监视点的种类：表达式监视点，或者物理地址范围上的数据监视点
+enum { WP_EXPR = 0, WP_WRITE = 1, WP_READ = 2, WP_ACCESS = WP_WRITE | WP_READ };
+
 typedef struct watchpoint {
     int NO;
     struct watchpoint *next;
   
     /* TODO: Add more members if necessary */
-    char expr[128];     // 存储要监视的表达式
+    int type;           // 监视点的种类
+    char *expr;         // 存储要监视的表达式
+    Expr *code;         // 编译后的表达式
     uint32_t old_val;   // 存储表达式的值
+    paddr_t addr;       // 数据监视点监视的地址范围
+    word_t len;
   
   } WP;
 
 // 在 sdb.h 中添加这些声明
 WP* new_wp();
+WP* new_data_wp(int type, paddr_t addr, word_t len);
 void free_wp(WP *wp);
 WP* find_wp(int NO);
 void list_watchpoints();
 bool check_watchpoints();
+bool has_watchpoints();
+
+#ifdef CONFIG_BREAKPOINT
+int new_bp(vaddr_t pc, char *cond, bool temp);
+bool free_bp(int NO);
+bool set_bp_ignore(int NO, uint64_t count);
+bool set_bp_trace(int NO, int kind);
+void list_breakpoints();
+#endif
 
 #endif
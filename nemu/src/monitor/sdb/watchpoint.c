@@ -13,7 +13,9 @@
 * See the Mulan PSL v2 for more details.
 ***************************************************************************************/
 
+#include <isa.h>
 #include "sdb.h"
+#include <memory/paddr.h>
 
 #define NR_WP 32
 
@@ -50,10 +52,57 @@ WP* new_wp() {
   // 将节点添加到head链表头部
   wp->next = head;
   head = wp;
+  wp->type = WP_EXPR;
   
   return wp;
 }
 
+#ifdef CONFIG_WATCHPOINT
+// 根据现有的数据监视点重新标记 pmem 页
+static void update_watch_pages() {
+  pmem_watch_clear();
+  for (WP *p = head; p != NULL; p = p->next) {
+    if (p->type != WP_EXPR) pmem_watch_set(p->addr, p->len, p->type);
+  }
+}
+
+// 设置物理地址 [addr, addr + len) 上的数据监视点
+WP* new_data_wp(int type, paddr_t addr, word_t len) {
+  WP *wp = new_wp();
+  wp->type = type;
+  wp->addr = addr;
+  wp->len = len;
+  pmem_watch_set(addr, len, type);
+  return wp;
+}
+
+static const char* data_wp_name(int type) {
+  return (type == WP_WRITE ? "write" : type == WP_READ ? "read" : "access");
+}
+
+/* 由访存路径调用：访问 [addr, addr + len) 与数据监视点重叠时打印访问的 pc 和数据。
+ * 写访问的 old_val 和 new_val 是写入前后的值，读访问二者相同。
+ */
+bool check_data_watchpoints(paddr_t addr, int len, bool is_write, word_t old_val, word_t new_val) {
+  bool triggered = false;
+  for (WP *p = head; p != NULL; p = p->next) {
+    if (!(p->type & (is_write ? WP_WRITE : WP_READ))) continue;
+    // 无符号减法同时处理了两个方向的重叠
+    if (addr - p->addr >= p->len && p->addr - addr >= (word_t)len) continue;
+    printf("Watchpoint %d: %s of %d bytes at " FMT_PADDR " by pc = " FMT_WORD "\n",
+        p->NO, (is_write ? "write" : "read"), len, addr, cpu.pc);
+    if (is_write) {
+      printf("Old value = " FMT_WORD "\n", old_val);
+      printf("New value = " FMT_WORD "\n", new_val);
+    } else {
+      printf("Value = " FMT_WORD "\n", new_val);
+    }
+    triggered = true;
+  }
+  return triggered;
+}
+#endif
+
 // 释放一个监视点，将其归还到空闲链表
 void free_wp(WP *wp) {
   if (wp == NULL) return;
@@ -82,8 +131,12 @@ void free_wp(WP *wp) {
   wp->next = free_;
   free_ = wp;
   
-  // 清除表达式（可选）
-  wp->expr[0] = '\0';
+  // 释放表达式
+  free(wp->expr);
+  wp->expr = NULL;
+  expr_free(wp->code);
+  wp->code = NULL;
+  IFDEF(CONFIG_WATCHPOINT, if (wp->type != WP_EXPR) update_watch_pages());
 }
 
 // 根据编号查找监视点   
@@ -108,19 +161,40 @@ void list_watchpoints() {
   printf("Num\tExpr\t\tValue\n");
   WP *p = head;
   while (p != NULL) {
-    printf("%d\t%s\t\t0x%08x\n", p->NO, p->expr, p->old_val);
+    if (p->type == WP_EXPR) {
+      printf("%d\t%s\t\t0x%08x\n", p->NO, p->expr, p->old_val);
+    }
+#ifdef CONFIG_WATCHPOINT
+    else {
+      printf("%d\t%s [" FMT_PADDR ", +%" PRIu64 ")\n", p->NO, data_wp_name(p->type), p->addr, (uint64_t)p->len);
+    }
+#endif
     p = p->next;
   }
 }
 
+// 是否设置了表达式监视点，没有时执行引擎可以跳过逐条指令的检查。
+// 数据监视点由访存路径按页检查，不需要逐条执行
+bool has_watchpoints() {
+  for (WP *p = head; p != NULL; p = p->next) {
+    if (p->type == WP_EXPR) return true;
+  }
+  return false;
+}
+
 // 检查所有监视点，返回是否有监视点被触发
 bool check_watchpoints() {
   WP *p = head;
   bool triggered = false;
   
   while (p != NULL) {
+    // 数据监视点在访存时检查
+    if (p->type != WP_EXPR) {
+      p = p->next;
+      continue;
+    }
     bool success=1;
-    uint32_t new_val = expr(p->expr, &success); // 重新计算表达式的值
+    uint32_t new_val = expr_eval(p->code, &success); // 重新计算表达式的值
     
     if (!success) {
       printf("Error: Failed to evaluate watchpoint expression '%s'\n", p->expr);
@@ -0,0 +1,243 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <isa.h>
+#include <cpu/cpu.h>
+#include <cpu/tb.h>
+#include <cpu/difftest.h>
+#include <memory/paddr.h>
+#include <monitor/snapshot.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* 快照文件的格式：
+ *   文件头
+ *   状态段：cpu、指令计数以及各设备的状态，由 snapshot_state() 依次写入
+ *   页表：每个 pmem 页一个 uint16_t，PAGE_STORED 表示该页保存在内存映像中，
+ *         PAGE_UNIFORM | b 表示整页都是字节 b，映像中对应位置是空洞
+ *   内存映像：从 pmem_offset 开始，按物理地址排列，大小为 CONFIG_MSIZE
+ * 内存映像按 SNAPSHOT_ALIGN 对齐，恢复时可以直接 mmap 到 pmem 上，
+ * 只有被客户程序写到的页才会真正从文件复制出来。
+ * 未被写过的页和全为同一字节的页（例如 MEM_RANDOM 填充的页）在文件中都是空洞，
+ * 不占用磁盘空间。
+ */
+#define SNAPSHOT_MAGIC "NEMUSNAP"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_ALIGN 0x10000
+
+#define NR_PAGE ((int)(CONFIG_MSIZE / PAGE_SIZE))
+#define PAGE_STORED  0
+#define PAGE_UNIFORM 0x100
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t page_size;
+  uint64_t mbase;
+  uint64_t msize;
+  char isa[16];
+  uint64_t state_size;
+  uint64_t pmem_offset;
+} SnapshotHeader;
+
+extern uint64_t g_nr_guest_inst;
+
+static uint16_t page_kind[NR_PAGE];
+
+void snapshot_data(Snapshot *ss, void *buf, size_t size) {
+  if (!ss->ok || size == 0) return;
+  size_t ret = ss->is_save ? fwrite(buf, size, 1, ss->fp) : fread(buf, size, 1, ss->fp);
+  if (ret != 1) ss->ok = false;
+}
+
+// 保存和恢复都按这里的顺序处理各模块的状态
+static void snapshot_state(Snapshot *ss) {
+  snapshot_data(ss, &cpu, sizeof(cpu));
+  snapshot_data(ss, &g_nr_guest_inst, sizeof(g_nr_guest_inst));
+  timer_snapshot(ss);
+  IFDEF(CONFIG_DEVICE, map_snapshot(ss));
+  IFDEF(CONFIG_HAS_KEYBOARD, keyboard_snapshot(ss));
+}
+
+static void init_header(SnapshotHeader *h) {
+  memset(h, 0, sizeof(*h));
+  memcpy(h->magic, SNAPSHOT_MAGIC, sizeof(h->magic));
+  h->version = SNAPSHOT_VERSION;
+  h->page_size = PAGE_SIZE;
+  h->mbase = CONFIG_MBASE;
+  h->msize = CONFIG_MSIZE;
+  strncpy(h->isa, str(__GUEST_ISA__), sizeof(h->isa) - 1);
+}
+
+static bool pwrite_all(int fd, const uint8_t *buf, size_t size, off_t offset) {
+  while (size > 0) {
+    ssize_t ret = pwrite(fd, buf, size, offset);
+    if (ret <= 0) return false;
+    buf += ret; size -= ret; offset += ret;
+  }
+  return true;
+}
+
+static bool pread_all(int fd, uint8_t *buf, size_t size, off_t offset) {
+  while (size > 0) {
+    ssize_t ret = pread(fd, buf, size, offset);
+    if (ret <= 0) return false;
+    buf += ret; size -= ret; offset += ret;
+  }
+  return true;
+}
+
+static bool save_pmem(FILE *fp, uint64_t pmem_offset) {
+  uint8_t *pmem = guest_to_host(PMEM_LEFT);
+  int fd = fileno(fp);
+  if (fflush(fp) != 0 || ftruncate(fd, pmem_offset + CONFIG_MSIZE) != 0) return false;
+  for (int i = 0; i < NR_PAGE; i ++) {
+    if (page_kind[i] != PAGE_STORED) continue;
+    if (!pwrite_all(fd, pmem + (size_t)i * PAGE_SIZE, PAGE_SIZE, pmem_offset + (uint64_t)i * PAGE_SIZE)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool snapshot_save(const char *file) {
+  uint8_t *pmem = guest_to_host(PMEM_LEFT);
+  int nr_stored = 0;
+  for (int i = 0; i < NR_PAGE; i ++) {
+    uint8_t *p = pmem + (size_t)i * PAGE_SIZE;
+    bool uniform = memcmp(p, p + 1, PAGE_SIZE - 1) == 0;
+    page_kind[i] = uniform ? (PAGE_UNIFORM | p[0]) : PAGE_STORED;
+    nr_stored += !uniform;
+  }
+
+  // 先删除旧文件，使之前从它 mmap 恢复出来的 pmem 仍然指向旧的内容
+  unlink(file);
+  FILE *fp = fopen(file, "w+");
+  if (fp == NULL) {
+    printf("Cannot open snapshot file '%s'\n", file);
+    return false;
+  }
+
+  SnapshotHeader h;
+  init_header(&h);
+  Snapshot ss = { .fp = fp, .is_save = true, .ok = true };
+  snapshot_data(&ss, &h, sizeof(h));
+  snapshot_state(&ss);
+  h.state_size = ftell(fp) - sizeof(h);
+  snapshot_data(&ss, page_kind, sizeof(page_kind));
+  h.pmem_offset = ROUNDUP(ftell(fp), SNAPSHOT_ALIGN);
+
+  if (ss.ok) ss.ok = save_pmem(fp, h.pmem_offset);
+  if (ss.ok) {
+    // 最后回填文件头
+    fseek(fp, 0, SEEK_SET);
+    snapshot_data(&ss, &h, sizeof(h));
+  }
+  if (fclose(fp) != 0) ss.ok = false;
+
+  if (!ss.ok) {
+    printf("Failed to write snapshot file '%s'\n", file);
+    unlink(file);
+    return false;
+  }
+  Log("Saved snapshot to %s at pc = " FMT_WORD ", %d of %d pages stored",
+      file, cpu.pc, nr_stored, NR_PAGE);
+  return true;
+}
+
+static bool check_header(const SnapshotHeader *h, int fd) {
+  SnapshotHeader expect;
+  init_header(&expect);
+  const char *msg = NULL;
+  if (memcmp(h->magic, expect.magic, sizeof(h->magic)) != 0) msg = "not a NEMU snapshot";
+  else if (h->version != expect.version) msg = "unsupported version";
+  else if (strcmp(h->isa, expect.isa) != 0) msg = "saved by a different ISA";
+  else if (h->page_size != expect.page_size || h->mbase != expect.mbase || h->msize != expect.msize) {
+    msg = "physical memory layout does not match";
+  }
+  else {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < h->pmem_offset + h->msize) msg = "file is truncated";
+  }
+  if (msg != NULL) printf("Invalid snapshot: %s\n", msg);
+  return msg == NULL;
+}
+
+static void load_pmem(int fd, uint64_t pmem_offset) {
+  uint8_t *pmem = guest_to_host(PMEM_LEFT);
+  bool mapped = false;
+#ifdef CONFIG_PMEM_GARRAY
+  // 私有映射：写时复制，客户程序的写入不会改动快照文件
+  if (pmem_offset % sysconf(_SC_PAGESIZE) == 0) {
+    void *p = mmap(pmem, CONFIG_MSIZE, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_FIXED, fd, pmem_offset);
+    mapped = (p != MAP_FAILED);
+  }
+#endif
+  if (!mapped) {
+    Assert(pread_all(fd, pmem, CONFIG_MSIZE, pmem_offset), "failed to read the memory image of snapshot");
+  }
+  for (int i = 0; i < NR_PAGE; i ++) {
+    uint8_t b = page_kind[i] & 0xff;
+    if (page_kind[i] != PAGE_STORED && b != 0) memset(pmem + (size_t)i * PAGE_SIZE, b, PAGE_SIZE);
+  }
+}
+
+// 内存和寄存器整体被替换，作废所有由它们推导出来的缓存
+static void flush_caches() {
+  IFDEF(CONFIG_DECODE_CACHE, isa_decode_cache_flush());
+  IFDEF(CONFIG_ENGINE_THREADED, MUXDEF(CONFIG_JIT, jit_flush(), tb_flush()));
+  IFDEF(CONFIG_SOFT_TLB, soft_tlb_flush());
+  IFDEF(CONFIG_RV_SV32, isa_mmu_flush());
+}
+
+bool snapshot_load(const char *file) {
+  FILE *fp = fopen(file, "r");
+  if (fp == NULL) {
+    printf("Cannot open snapshot file '%s'\n", file);
+    return false;
+  }
+
+  SnapshotHeader h;
+  Snapshot ss = { .fp = fp, .is_save = false, .ok = true };
+  snapshot_data(&ss, &h, sizeof(h));
+  if (!ss.ok || !check_header(&h, fileno(fp))) {
+    if (!ss.ok) printf("Invalid snapshot: file is truncated\n");
+    fclose(fp);
+    return false;
+  }
+
+  // 文件头检查通过后才开始改写机器状态，此后再出错机器状态已经不完整
+  snapshot_state(&ss);
+  Assert(ss.ok && ftell(fp) == sizeof(h) + h.state_size, "snapshot file '%s' is corrupted", file);
+  snapshot_data(&ss, page_kind, sizeof(page_kind));
+  Assert(ss.ok, "snapshot file '%s' is corrupted", file);
+  load_pmem(fileno(fp), h.pmem_offset);
+  fclose(fp);
+
+  flush_caches();
+#ifdef CONFIG_DIFFTEST
+  if (ref_difftest_memcpy != NULL) {
+    ref_difftest_memcpy(PMEM_LEFT, guest_to_host(PMEM_LEFT), CONFIG_MSIZE, DIFFTEST_TO_REF);
+    ref_difftest_regcpy(&cpu, DIFFTEST_TO_REF);
+  }
+#endif
+  nemu_state.state = NEMU_STOP;
+  Log("Restored snapshot from %s at pc = " FMT_WORD, file, cpu.pc);
+  return true;
+}
@@ -22,3 +22,13 @@ src/utils/disasm.c: $(LIBCAPSTONE)
 $(LIBCAPSTONE):
 	$(MAKE) -C tools/capstone
 endif
+
+ifndef CONFIG_TRACE
+SRCS-BLACKLIST-y += src/utils/trace.c
+endif
+
+ifndef CONFIG_TRACE_BINARY
+SRCS-BLACKLIST-y += src/utils/tracebin.c
+endif
+
+LIBS += $(if $(CONFIG_LOG_ASYNC),-lpthread,)
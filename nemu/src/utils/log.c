@@ -15,23 +15,163 @@
 
 #include <common.h>
 
-extern uint64_t g_nr_guest_inst;
-
 #ifndef CONFIG_TARGET_AM
 FILE *log_fp = NULL;
 
+#ifdef CONFIG_LOG_ASYNC
+#include <pthread.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <time.h>
+
+/* 单生产者单消费者的无锁环形缓冲区：模拟线程只负责把格式化好的日志
+ * 拷贝进来，后台线程负责写文件。head 只由生产者修改，tail 只由消费者
+ * 修改，二者都单调递增，取模后才是缓冲区中的位置。
+ */
+#define LOG_BUF_SIZE (CONFIG_LOG_ASYNC_BUF_SIZE * 1024)
+static_assert((LOG_BUF_SIZE & (LOG_BUF_SIZE - 1)) == 0,
+    "CONFIG_LOG_ASYNC_BUF_SIZE must be a power of 2");
+
+static char log_buf[LOG_BUF_SIZE];
+static uint64_t log_head = 0;
+static uint64_t log_tail = 0;
+static uint64_t log_dropped = 0;
+static bool log_stop = false;
+static bool log_async_running = false;
+static pthread_t log_thread;
+
+static void* log_consumer(void *arg) {
+  int idle = 0;
+  while (true) {
+    uint64_t head = __atomic_load_n(&log_head, __ATOMIC_ACQUIRE);
+    uint64_t tail = log_tail;
+    if (head == tail) {
+      if (__atomic_load_n(&log_stop, __ATOMIC_ACQUIRE)) {
+        // 停止前生产者已经不再写入，再检查一次确保没有遗漏
+        if (__atomic_load_n(&log_head, __ATOMIC_ACQUIRE) == tail) break;
+        continue;
+      }
+      // 空闲时先让出 CPU，长时间空闲再睡眠
+      if (idle < 64) { idle ++; sched_yield(); }
+      else nanosleep(&(struct timespec){ .tv_nsec = 100000 }, NULL);
+      continue;
+    }
+    idle = 0;
+    while (tail != head) {
+      uint64_t off = tail & (LOG_BUF_SIZE - 1);
+      uint64_t len = head - tail;
+      if (len > LOG_BUF_SIZE - off) len = LOG_BUF_SIZE - off;
+      fwrite(log_buf + off, 1, len, log_fp);
+      tail += len;
+    }
+    fflush(log_fp);
+    __atomic_store_n(&log_tail, tail, __ATOMIC_RELEASE);
+  }
+  return NULL;
+}
+
+static void log_push(const char *str, uint64_t len) {
+  uint64_t head = log_head;
+  if (MUXDEF(CONFIG_LOG_ASYNC_DROP, true, false) &&
+      len > LOG_BUF_SIZE - (head - __atomic_load_n(&log_tail, __ATOMIC_ACQUIRE))) {
+    log_dropped ++;
+    return;
+  }
+  while (len > 0) {
+    uint64_t space = LOG_BUF_SIZE - (head - __atomic_load_n(&log_tail, __ATOMIC_ACQUIRE));
+    if (space == 0) { sched_yield(); continue; }
+    uint64_t off = head & (LOG_BUF_SIZE - 1);
+    uint64_t n = (len < space ? len : space);
+    if (n > LOG_BUF_SIZE - off) n = LOG_BUF_SIZE - off;
+    memcpy(log_buf + off, str, n);
+    str += n;
+    len -= n;
+    head += n;
+    __atomic_store_n(&log_head, head, __ATOMIC_RELEASE);
+  }
+}
+
+void log_async_write(const char *fmt, ...) {
+  char buf[1024];
+  va_list ap;
+  va_start(ap, fmt);
+  int len = vsnprintf(buf, sizeof(buf), fmt, ap);
+  va_end(ap);
+  if (len < 0) return;
+
+  if (!log_async_running) {
+    // 后台线程没有启动或已经退出，直接写文件
+    fputs(buf, log_fp);
+    fflush(log_fp);
+    return;
+  }
+  if (len < sizeof(buf)) { log_push(buf, len); return; }
+
+  // 超长的记录在堆上重新格式化
+  char *p = malloc(len + 1);
+  va_start(ap, fmt);
+  vsnprintf(p, len + 1, fmt, ap);
+  va_end(ap);
+  log_push(p, len);
+  free(p);
+}
+
+static void log_report_dropped() {
+  if (log_dropped > 0) {
+    fprintf(log_fp, "[log] %" PRIu64 " log records dropped because the ring buffer was full\n",
+        log_dropped);
+    log_dropped = 0;
+  }
+}
+
+void log_flush() {
+  if (log_fp == NULL) return;
+  if (log_async_running) {
+    while (__atomic_load_n(&log_tail, __ATOMIC_ACQUIRE) !=
+           __atomic_load_n(&log_head, __ATOMIC_ACQUIRE)) {
+      sched_yield();
+    }
+  }
+  log_report_dropped();
+  fflush(log_fp);
+}
+
+static void log_async_exit() {
+  if (!log_async_running) return;
+  __atomic_store_n(&log_stop, true, __ATOMIC_RELEASE);
+  pthread_join(log_thread, NULL);
+  log_async_running = false;
+  log_report_dropped();
+  fflush(log_fp);
+}
+
+static void init_log_async() {
+  int ret = pthread_create(&log_thread, NULL, log_consumer, NULL);
+  Assert(ret == 0, "Can not create the log thread");
+  log_async_running = true;
+  atexit(log_async_exit);
+}
+#else
+void log_flush() {
+  if (log_fp != NULL) fflush(log_fp);
+}
+#endif
+
 void init_log(const char *log_file) {
   log_fp = stdout;
   if (log_file != NULL) {
     FILE *fp = fopen(log_file, "w");
     Assert(fp, "Can not open '%s'", log_file);
     log_fp = fp;
+    // 写到标准输出时保持同步，以免与 printf 的输出交错
+    IFDEF(CONFIG_LOG_ASYNC, init_log_async());
   }
   Log("Log is written to %s", log_file ? log_file : "stdout");
 }
 
+// 追踪窗口由 src/utils/trace.c 在运行时控制
 bool log_enable() {
-  return MUXDEF(CONFIG_TRACE, (g_nr_guest_inst >= CONFIG_TRACE_START) &&
-         (g_nr_guest_inst <= CONFIG_TRACE_END), false);
+  return MUXDEF(CONFIG_TRACE, ((trace_active | trace_inst_active) &
+        (TRACE_LOG | TRACE_ITRACE | TRACE_MTRACE)) != 0, false);
 }
 #endif
@@ -15,6 +15,9 @@
 
 #include <common.h>
 #include MUXDEF(CONFIG_TIMER_GETTIMEOFDAY, <sys/time.h>, <time.h>)
+#ifdef CONFIG_SNAPSHOT
+#include <monitor/snapshot.h>
+#endif
 
 IFDEF(CONFIG_TIMER_CLOCK_GETTIME,
     static_assert(CLOCKS_PER_SEC == 1000000, "CLOCKS_PER_SEC != 1000000"));
@@ -44,6 +47,15 @@ uint64_t get_time() {
   return now - boot_time;
 }
 
+#ifdef CONFIG_SNAPSHOT
+// 保存的是客户机已经运行的时间, 恢复后时间从该点继续走
+void timer_snapshot(Snapshot *ss) {
+  uint64_t uptime = get_time();
+  snapshot_data(ss, &uptime, sizeof(uptime));
+  if (!ss->is_save && ss->ok) boot_time = get_time_internal() - uptime;
+}
+#endif
+
 void init_rand() {
   srand(get_time_internal());
 }
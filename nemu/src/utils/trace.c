@@ -0,0 +1,286 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <common.h>
+#include <monitor/ftrace.h>
+#include <memory/vaddr.h>
+
+/* 运行时控制的追踪窗口。每个窗口带有一组追踪种类和一个触发条件：
+ * 指令数区间、pc 区间，或者从进入某个函数到它返回。生效的追踪是
+ * 手动打开的种类与所有打开着的窗口的种类之并，记在 trace_active 中。
+ * 没有窗口要逐条检查时，执行循环走不带任何追踪检查的快速路径。
+ */
+#define MAX_TRACE_WINDOW 16
+
+enum { WIN_INST, WIN_PC, WIN_FUNC };
+
+typedef struct {
+  int kind;          // 追踪种类
+  int type;          // 触发条件
+  uint64_t lo, hi;   // 指令数或 pc 的闭区间；函数窗口的 lo 是函数的起始地址
+  char *name;        // 函数名
+  int depth;         // 函数窗口：进入函数时的调用深度
+  bool open;
+} TraceWindow;
+
+static TraceWindow windows[MAX_TRACE_WINDOW];
+static int nr_window = 0;
+static int trace_manual = 0;
+int trace_active = 0;
+int trace_inst_active = 0;
+
+extern uint64_t g_nr_guest_inst;
+
+// 可用的追踪种类
+#define TRACE_AVAILABLE (TRACE_FTRACE | MUXDEF(CONFIG_ITRACE, TRACE_ITRACE, 0) | \
+    MUXDEF(CONFIG_MTRACE, TRACE_MTRACE, 0))
+// 需要逐条指令执行的追踪种类
+#define TRACE_STEP (TRACE_ITRACE | TRACE_MTRACE)
+
+static void trace_update() {
+  int active = trace_manual;
+  for (int i = 0; i < nr_window; i ++) {
+    if (windows[i].open) active |= windows[i].kind;
+  }
+#if defined(CONFIG_MTRACE) && defined(CONFIG_SOFT_TLB)
+  // 打开 mtrace 后访存不能再走软件 TLB 的快速路径
+  if (active & ~trace_active & TRACE_MTRACE) soft_tlb_flush();
+#endif
+  trace_active = active;
+}
+
+void trace_set(int kind, bool on) {
+  if (on) trace_manual |= kind;
+  else {
+    trace_manual &= ~kind;
+    // 关闭的种类同时从所有窗口中去掉
+    for (int i = 0; i < nr_window; i ++) windows[i].kind &= ~kind;
+  }
+  trace_update();
+  trace_inst_active = trace_active;
+}
+
+static TraceWindow* new_window(int kind, int type) {
+  if (nr_window == MAX_TRACE_WINDOW) {
+    printf("Too many trace windows\n");
+    return NULL;
+  }
+  TraceWindow *w = &windows[nr_window ++];
+  w->kind = kind;
+  w->type = type;
+  w->name = NULL;
+  w->depth = -1;
+  w->open = false;
+  return w;
+}
+
+// 删除所有窗口并关闭所有追踪
+void trace_clear() {
+  for (int i = 0; i < nr_window; i ++) free(windows[i].name);
+  nr_window = 0;
+  trace_manual = 0;
+  trace_update();
+}
+
+/* 选择执行循环之前调用：按下一条指令的序号更新指令数窗口，
+ * 并把 *n 截到最近的窗口边界上。返回是否需要逐条指令执行。
+ */
+bool trace_need_step(uint64_t *n) {
+  uint64_t next = g_nr_guest_inst + 1;
+  bool step = false;
+  for (int i = 0; i < nr_window; i ++) {
+    TraceWindow *w = &windows[i];
+    switch (w->type) {
+      case WIN_INST:
+        if (next < w->lo) {
+          w->open = false;
+          if (*n > w->lo - next) *n = w->lo - next;
+        } else if (next <= w->hi) {
+          w->open = true;
+          if (*n > w->hi - next + 1) *n = w->hi - next + 1;
+          if (w->kind & TRACE_STEP) step = true;
+        } else {
+          w->open = false;
+        }
+        break;
+      // pc 区间要逐条检查；函数窗口由 ftrace 打开，打开后要逐条记录
+      case WIN_PC: step = true; break;
+      case WIN_FUNC: if (w->kind & TRACE_STEP) step = true; break;
+    }
+  }
+  trace_update();
+  trace_inst_active = trace_active;
+  return step || (trace_active & TRACE_STEP);
+}
+
+/* 逐条执行时在每条指令执行之前调用，pc 是这条指令的地址。
+ * 调用和返回会在指令执行过程中打开或关闭函数窗口，itrace 和日志按
+ * 执行之前的状态 trace_inst_active 记录，窗口才恰好包含函数内的指令。
+ */
+void trace_step(vaddr_t pc) {
+  if (nr_window > 0) {
+    uint64_t next = g_nr_guest_inst + 1;
+    for (int i = 0; i < nr_window; i ++) {
+      TraceWindow *w = &windows[i];
+      if (w->type == WIN_INST) w->open = (next >= w->lo && next <= w->hi);
+      else if (w->type == WIN_PC) w->open = (pc >= w->lo && pc <= w->hi);
+    }
+    trace_update();
+  }
+  trace_inst_active = trace_active;
+}
+
+// 由 ftrace 调用，depth 是调用之前的深度
+void trace_func_call(vaddr_t target, int depth) {
+  bool changed = false;
+  for (int i = 0; i < nr_window; i ++) {
+    TraceWindow *w = &windows[i];
+    if (w->type == WIN_FUNC && !w->open && w->lo == target) {
+      w->open = true;
+      w->depth = depth;
+      changed = true;
+    }
+  }
+  if (changed) trace_update();
+}
+
+// 由 ftrace 调用，depth 是返回之后的深度
+void trace_func_ret(int depth) {
+  bool changed = false;
+  for (int i = 0; i < nr_window; i ++) {
+    TraceWindow *w = &windows[i];
+    if (w->type == WIN_FUNC && w->open && depth <= w->depth) {
+      w->open = false;
+      changed = true;
+    }
+  }
+  if (changed) trace_update();
+}
+
+static const char* kind_str(int kind) {
+  static char buf[64];
+  buf[0] = '\0';
+  if (kind & TRACE_ITRACE) strcat(buf, ",itrace");
+  if (kind & TRACE_FTRACE) strcat(buf, ",ftrace");
+  if (kind & TRACE_MTRACE) strcat(buf, ",mtrace");
+  if (kind & TRACE_LOG)    strcat(buf, ",log");
+  return (buf[0] ? buf + 1 : "none");
+}
+
+// 解析 "itrace,ftrace" 这样的追踪种类，失败时返回 -1
+int trace_parse_kind(const char *str) {
+  int kind = 0;
+  char buf[64];
+  snprintf(buf, sizeof(buf), "%s", str);
+  char *save = NULL;
+  for (char *t = strtok_r(buf, ",", &save); t != NULL; t = strtok_r(NULL, ",", &save)) {
+    int k = 0;
+    if (strcmp(t, "itrace") == 0) k = TRACE_ITRACE;
+    else if (strcmp(t, "ftrace") == 0) k = TRACE_FTRACE;
+    else if (strcmp(t, "mtrace") == 0) k = TRACE_MTRACE;
+    else if (strcmp(t, "all") == 0) k = TRACE_AVAILABLE;
+    if (k == 0 || (k & ~TRACE_AVAILABLE)) {
+      printf("Unknown or disabled trace '%s'\n", t);
+      return -1;
+    }
+    kind |= k;
+  }
+  return kind;
+}
+
+static void list_windows() {
+  printf("Active: %s\n", kind_str(trace_active));
+  printf("Manual: %s\n", kind_str(trace_manual));
+  for (int i = 0; i < nr_window; i ++) {
+    TraceWindow *w = &windows[i];
+    printf("%d\t%-20s %s ", i, kind_str(w->kind), (w->open ? "open  " : "closed"));
+    switch (w->type) {
+      case WIN_INST: printf("inst [%" PRIu64 ", %" PRIu64 "]\n", w->lo, w->hi); break;
+      case WIN_PC: printf("pc [" FMT_WORD ", " FMT_WORD "]\n", (word_t)w->lo, (word_t)w->hi); break;
+      case WIN_FUNC: printf("func %s\n", w->name); break;
+    }
+  }
+}
+
+/* 解析追踪命令，sdb 的 trace 命令和 --trace-window 共用：
+ *   (空)                   列出追踪状态
+ *   clear                  删除所有窗口，关闭所有追踪
+ *   on|off KINDS           立即打开或关闭
+ *   KINDS inst START END   第 START 到第 END 条指令
+ *   KINDS pc LO HI         pc 在 [LO, HI] 中时
+ *   KINDS func NAME        从进入函数 NAME 到它返回
+ */
+bool trace_command(char *args) {
+  char *save = NULL;
+  char *t1 = (args ? strtok_r(args, " ", &save) : NULL);
+  if (t1 == NULL) { list_windows(); return true; }
+  if (strcmp(t1, "clear") == 0) { trace_clear(); return true; }
+
+  char *t2 = strtok_r(NULL, " ", &save);
+  if (t2 == NULL) goto usage;
+  if (strcmp(t1, "on") == 0 || strcmp(t1, "off") == 0) {
+    int kind = trace_parse_kind(t2);
+    if (kind < 0) return false;
+    trace_set(kind, t1[1] == 'n');
+    return true;
+  }
+
+  int kind = trace_parse_kind(t1);
+  if (kind < 0) return false;
+  char *a = strtok_r(NULL, " ", &save);
+  char *b = strtok_r(NULL, " ", &save);
+  if (a == NULL) goto usage;
+  TraceWindow *w = NULL;
+  if (strcmp(t2, "inst") == 0 || strcmp(t2, "pc") == 0) {
+    if (b == NULL) goto usage;
+    uint64_t lo = strtoull(a, NULL, 0), hi = strtoull(b, NULL, 0);
+    if (lo > hi) goto usage;
+    w = new_window(kind, t2[0] == 'i' ? WIN_INST : WIN_PC);
+    if (w == NULL) return false;
+    w->lo = lo;
+    w->hi = hi;
+  } else if (strcmp(t2, "func") == 0) {
+    FuncInfo *f = find_function_by_name(a);
+    if (f == NULL) {
+      printf("Unknown function '%s', load its symbols with --elf\n", a);
+      return false;
+    }
+    w = new_window(kind, WIN_FUNC);
+    if (w == NULL) return false;
+    w->lo = f->addr;
+    w->name = strdup(a);
+  } else goto usage;
+
+  if (w->type == WIN_INST) w->open = (g_nr_guest_inst >= w->lo && g_nr_guest_inst <= w->hi);
+  trace_update();
+  return true;
+
+usage:
+  printf("Usage: trace [clear | on|off KINDS | KINDS inst START END | KINDS pc LO HI | KINDS func NAME]\n"
+         "KINDS is a comma separated list of itrace, ftrace, mtrace or all\n");
+  return false;
+}
+
+void init_trace() {
+  // 默认窗口：日志和 itrace 只记录 [CONFIG_TRACE_START, CONFIG_TRACE_END] 内的指令
+  TraceWindow *w = new_window(TRACE_LOG | MUXDEF(CONFIG_ITRACE, TRACE_ITRACE, 0), WIN_INST);
+  w->lo = CONFIG_TRACE_START;
+  w->hi = CONFIG_TRACE_END;
+  w->open = (g_nr_guest_inst >= w->lo && g_nr_guest_inst <= w->hi);
+  // 加载了符号时 ftrace 默认输出
+  trace_manual = TRACE_FTRACE;
+  trace_update();
+}
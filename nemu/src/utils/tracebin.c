@@ -0,0 +1,115 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <common.h>
+#include <trace-format.h>
+
+#define TRACE_BUF_SIZE (4 * 1024 * 1024)
+// 一个记录最多占用的字节数：标签、两个 varint 和指令
+#define TRACE_RECORD_MAX (1 + 10 + 10 + 16)
+
+static FILE *trace_fp = NULL;
+static uint8_t *trace_buf = NULL;
+static size_t trace_len = 0;
+static vaddr_t last_pc = 0, last_snpc = 0;
+static uint64_t trace_depth = 0;
+
+/* ftrace 在指令执行的过程中报告调用和返回，此时这条指令还没有写入追踪流，
+ * 先记下来，等指令记录写入之后再紧跟着写入，这样 pc 就是上一条指令的地址。
+ */
+static struct {
+  int type;  // 0 表示没有
+  vaddr_t target;
+  uint64_t depth;
+} pending_jump = {};
+
+bool tracebin_enabled() {
+  return trace_fp != NULL;
+}
+
+void tracebin_flush() {
+  if (trace_fp == NULL || trace_len == 0) return;
+  size_t ret = fwrite(trace_buf, 1, trace_len, trace_fp);
+  Assert(ret == trace_len, "failed to write the binary trace");
+  trace_len = 0;
+  fflush(trace_fp);
+}
+
+static void tracebin_close() {
+  if (trace_fp == NULL) return;
+  tracebin_flush();
+  fclose(trace_fp);
+  trace_fp = NULL;
+  free(trace_buf);
+}
+
+void init_tracebin(const char *file) {
+  trace_fp = fopen(file, "wb");
+  Assert(trace_fp, "Can not open '%s'", file);
+  trace_buf = malloc(TRACE_BUF_SIZE);
+  assert(trace_buf);
+
+  TraceHeader h = { .magic = TRACE_MAGIC, .version = TRACE_VERSION, .word_size = sizeof(word_t) };
+  strncpy(h.isa, str(__GUEST_ISA__), sizeof(h.isa) - 1);
+  fwrite(&h, sizeof(h), 1, trace_fp);
+  atexit(tracebin_close);
+  Log("Binary trace is written to %s, use tools/trace-dump to decode it", file);
+}
+
+static inline uint8_t* trace_reserve() {
+  if (unlikely(trace_len + TRACE_RECORD_MAX > TRACE_BUF_SIZE)) tracebin_flush();
+  return trace_buf + trace_len;
+}
+
+static void tracebin_jump(int type, vaddr_t pc, vaddr_t target, uint64_t depth) {
+  uint8_t *p = trace_reserve(), *start = p;
+  *p ++ = TRACE_TAG(type, 0);
+  p += trace_put_varint(p, trace_zigzag((sword_t)(target - pc)));
+  p += trace_put_varint(p, depth);
+  trace_len += p - start;
+}
+
+void tracebin_inst(vaddr_t pc, const uint8_t *inst, int ilen) {
+  uint8_t *p = trace_reserve(), *start = p;
+  if (pc == last_snpc) {
+    *p ++ = TRACE_TAG(TRACE_INST_SEQ, ilen);
+  } else {
+    *p ++ = TRACE_TAG(TRACE_INST, ilen);
+    p += trace_put_varint(p, trace_zigzag((sword_t)(pc - last_pc)));
+  }
+  memcpy(p, inst, ilen);
+  p += ilen;
+  trace_len += p - start;
+  last_pc = pc;
+  last_snpc = pc + ilen;
+  if (pending_jump.type != 0) {
+    tracebin_jump(pending_jump.type, pc, pending_jump.target, pending_jump.depth);
+    pending_jump.type = 0;
+  }
+}
+
+void tracebin_call(vaddr_t pc, vaddr_t target) {
+  pending_jump.type = TRACE_CALL;
+  pending_jump.target = target;
+  pending_jump.depth = trace_depth ++;
+}
+
+void tracebin_ret(vaddr_t pc, vaddr_t target) {
+  if (trace_depth > 0) trace_depth --;
+  pending_jump.type = TRACE_RET;
+  pending_jump.target = target;
+  pending_jump.depth = trace_depth;
+}
@@ -0,0 +1,40 @@
+#***************************************************************************************
+# Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+#
+# NEMU is licensed under Mulan PSL v2.
+# You can use this software according to the terms and conditions of the Mulan PSL v2.
+# You may obtain a copy of Mulan PSL v2 at:
+#          http://license.coscl.org.cn/MulanPSL2
+#
+# THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+# EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+# MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+#
+# See the Mulan PSL v2 for more details.
+#**************************************************************************************/
+
+ifdef CONFIG_INSTPAT_DECODER
+GEN_DECODER_PATH := $(NEMU_HOME)/tools/gen-decoder
+GEN_DECODER := $(GEN_DECODER_PATH)/build/gen-decoder
+INSTPAT_SRC := src/isa/$(GUEST_ISA)/inst.c
+INSTPAT_DECODER := $(NEMU_HOME)/include/generated/instpat-decoder.h
+INSTPAT_STAMP := $(INSTPAT_DECODER).stamp
+
+$(GEN_DECODER): $(GEN_DECODER_PATH)/gen-decoder.c
+	$(Q)$(MAKE) $(silent) -C $(GEN_DECODER_PATH)
+
+# auto.conf changes when switching to another ISA.
+# The generator only rewrites the header when its content changes, so that
+# objects including it are not rebuilt; the stamp records when it last ran
+$(INSTPAT_STAMP): $(INSTPAT_SRC) $(GEN_DECODER) $(NEMU_HOME)/include/config/auto.conf
+	@echo + GEN $(notdir $(INSTPAT_DECODER))
+	@mkdir -p $(dir $@)
+	@$(GEN_DECODER) $(INSTPAT_SRC) $(INSTPAT_DECODER)
+	@touch $@
+
+$(INSTPAT_DECODER): $(INSTPAT_STAMP)
+	@test -f $@ || $(GEN_DECODER) $(INSTPAT_SRC) $@
+
+# cpu/decode.h includes the generated decoder
+$(OBJS): | $(INSTPAT_DECODER)
+endif
@@ -0,0 +1,332 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+/* Read the INSTPAT tables of an inst.c and emit a decision-tree decoder
+ * for each INSTPAT_START/INSTPAT_END region.
+ *
+ *   usage: gen-decoder inst.c output.h
+ *
+ * For the region starting at line L and ending at line E, the output contains
+ *   static inline int __instpat_decode_L(uint64_t inst);
+ *   #define __instpat_count_E <number of INSTPATs in the region>
+ * The decoder returns the index (in source order) of the first pattern which
+ * matches `inst`, or -1. It switches on the bit fields shared by most of the
+ * remaining candidates (e.g. opcode, then funct3/funct7 for riscv32), so the
+ * cost is independent of the number of patterns. See include/cpu/decode.h
+ * for how the result is used.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <assert.h>
+
+#define MAX_PAT 1024
+#define MAX_REGION 64
+// the widest field switched on at once
+#define MAX_FIELD_BITS 10
+
+typedef struct {
+  uint64_t key, mask;
+  int id;
+} Pattern;
+
+typedef struct {
+  int start_line, end_line;
+  int width;
+  int nr_pat;
+  Pattern pat[MAX_PAT];
+} Region;
+
+static Region region[MAX_REGION];
+static int nr_region = 0;
+static const char *src_name = NULL;
+
+static void fatal(int line, const char *msg) {
+  fprintf(stderr, "%s:%d: gen-decoder: %s\n", src_name, line, msg);
+  exit(1);
+}
+
+static char* read_file(const char *name) {
+  FILE *fp = fopen(name, "r");
+  if (fp == NULL) { perror(name); exit(1); }
+  fseek(fp, 0, SEEK_END);
+  long size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  char *buf = malloc(size + 1);
+  assert(buf);
+  size_t ret = fread(buf, 1, size, fp);
+  assert(ret == size);
+  buf[size] = '\0';
+  fclose(fp);
+  return buf;
+}
+
+// replace comments with spaces, keeping newlines so that line numbers do not change
+static void strip_comments(char *p) {
+  while (*p) {
+    if (p[0] == '/' && p[1] == '/') {
+      while (*p && *p != '\n') *p++ = ' ';
+    } else if (p[0] == '/' && p[1] == '*') {
+      *p++ = ' '; *p++ = ' ';
+      while (*p && !(p[0] == '*' && p[1] == '/')) { if (*p != '\n') *p = ' '; p++; }
+      if (*p) { *p++ = ' '; *p++ = ' '; }
+    } else if (*p == '"' || *p == '\'') {
+      char q = *p++;
+      while (*p && *p != q) { if (*p == '\\' && p[1]) p++; p++; }
+      if (*p) p++;
+    } else {
+      p++;
+    }
+  }
+}
+
+static bool is_ident(char c) { return isalnum((unsigned char)c) || c == '_'; }
+
+// does `p` start the identifier `word` followed by '('?
+static const char* match_call(const char *begin, const char *p, const char *word) {
+  size_t len = strlen(word);
+  if (strncmp(p, word, len) != 0) return NULL;
+  if (p > begin && is_ident(p[-1])) return NULL;
+  p += len;
+  while (*p == ' ' || *p == '\t') p++;
+  return (*p == '(' ? p + 1 : NULL);
+}
+
+static void add_pattern(Region *r, const char *pat, int len, int line) {
+  uint64_t key = 0, mask = 0;
+  int width = 0;
+  for (int i = 0; i < len; i++) {
+    char c = pat[i];
+    if (c == ' ') continue;
+    if (c != '0' && c != '1' && c != '?') fatal(line, "invalid character in pattern string");
+    key  = (key  << 1) | (c == '1');
+    mask = (mask << 1) | (c != '?');
+    width++;
+  }
+  if (width > 64) fatal(line, "pattern too long");
+  if (r->nr_pat == 0) r->width = width;
+  else if (r->width != width) fatal(line, "patterns in one table have different length");
+  if (r->nr_pat == MAX_PAT) fatal(line, "too many patterns");
+  r->pat[r->nr_pat] = (Pattern) { .key = key, .mask = mask, .id = r->nr_pat };
+  r->nr_pat++;
+}
+
+static void parse(char *src) {
+  Region *cur = NULL;
+  int line = 1;
+  bool bol = true, directive = false;
+  for (const char *p = src; *p; p++) {
+    if (*p == '\n') {
+      // a directive continues on the next line if the line ends with '\'
+      if (!(directive && p > src && p[-1] == '\\')) directive = false;
+      line++; bol = true;
+      continue;
+    }
+    if (isspace((unsigned char)*p)) continue;
+    if (bol && *p == '#') directive = true;
+    bol = false;
+    if (directive) continue;
+
+    const char *q;
+    if ((q = match_call(src, p, "INSTPAT_START")) != NULL) {
+      if (cur != NULL) fatal(line, "nested INSTPAT_START");
+      if (nr_region == MAX_REGION) fatal(line, "too many INSTPAT tables");
+      cur = &region[nr_region++];
+      cur->start_line = line;
+      p = q - 1;
+    } else if ((q = match_call(src, p, "INSTPAT_END")) != NULL) {
+      if (cur == NULL) fatal(line, "INSTPAT_END without INSTPAT_START");
+      cur->end_line = line;
+      cur = NULL;
+      p = q - 1;
+    } else if ((q = match_call(src, p, "INSTPAT")) != NULL) {
+      if (cur == NULL) fatal(line, "INSTPAT outside INSTPAT_START/INSTPAT_END");
+      while (isspace((unsigned char)*q)) q++;
+      if (*q != '"') fatal(line, "the pattern of INSTPAT must be a string literal");
+      const char *end = strchr(q + 1, '"');
+      if (end == NULL) fatal(line, "unterminated pattern string");
+      add_pattern(cur, q + 1, end - q - 1, line);
+      p = end;
+    }
+  }
+  if (cur != NULL) fatal(cur->start_line, "INSTPAT_START without INSTPAT_END");
+}
+
+/* ---------- decision tree ---------- */
+
+static FILE *out = NULL;
+
+static void indent(int level) {
+  for (int i = 0; i < level; i++) fputs("  ", out);
+}
+
+// is `p` still possible when the bits in `fixed` of the instruction equal `val`?
+static bool compatible(const Pattern *p, uint64_t fixed, uint64_t val) {
+  return ((p->key ^ val) & p->mask & fixed) == 0;
+}
+
+// bits `bits` (ascending bit numbers) of the instruction, packed together
+static void emit_field(const int *bits, int n) {
+  int pos = 0;
+  for (int i = 0; i < n; ) {
+    int j = i;
+    while (j + 1 < n && bits[j + 1] == bits[j] + 1) j++;
+    int len = j - i + 1;
+    if (pos > 0) fputs(" | ", out);
+    fprintf(out, "(((inst >> %d) & 0x%llx)", bits[i], (unsigned long long)((1ull << len) - 1));
+    if (pos > 0) fprintf(out, " << %d", pos);
+    fputs(")", out);
+    pos += len;
+    i = j + 1;
+  }
+}
+
+static void build(Pattern **cand, int n, uint64_t known, int width, int level) {
+  if (n == 0) { indent(level); fputs("return -1;\n", out); return; }
+
+  // the first candidate needs no more checks: it wins
+  if ((cand[0]->mask & ~known) == 0) {
+    indent(level); fprintf(out, "return %d;\n", cand[0]->id);
+    return;
+  }
+
+  int score[64] = {}, best = 0;
+  for (int b = 0; b < width; b++) {
+    if (known & (1ull << b)) continue;
+    for (int i = 0; i < n; i++) score[b] += (cand[i]->mask >> b) & 1;
+    if (score[b] > best) best = score[b];
+  }
+
+  if (n <= 3) {
+    // few candidates left, check them one by one in source order
+    for (int i = 0; i < n; i++) {
+      uint64_t m = cand[i]->mask & ~known;
+      indent(level);
+      if (m == 0) { fprintf(out, "return %d;\n", cand[i]->id); return; }
+      fprintf(out, "if ((inst & 0x%llx) == 0x%llx) return %d;\n", (unsigned long long)m,
+          (unsigned long long)(cand[i]->key & m), cand[i]->id);
+    }
+    indent(level); fputs("return -1;\n", out);
+    return;
+  }
+
+  // switch on the bits which are fixed by the most candidates
+  int bits[MAX_FIELD_BITS], nr_bits = 0;
+  for (int b = 0; b < width && nr_bits < MAX_FIELD_BITS; b++) {
+    if (!(known & (1ull << b)) && score[b] == best) bits[nr_bits++] = b;
+  }
+  uint64_t field = 0;
+  for (int i = 0; i < nr_bits; i++) field |= 1ull << bits[i];
+
+  int nr_val = 1 << nr_bits;
+  Pattern ***sub = malloc(sizeof(Pattern **) * nr_val);
+  int *nr_sub = malloc(sizeof(int) * nr_val);
+  int *group = malloc(sizeof(int) * nr_val);  // first value with the same candidates
+  int *group_size = calloc(nr_val, sizeof(int));
+  assert(sub && nr_sub && group && group_size);
+  for (int v = 0; v < nr_val; v++) {
+    uint64_t val = 0;
+    for (int i = 0; i < nr_bits; i++) val |= (uint64_t)((v >> i) & 1) << bits[i];
+    sub[v] = malloc(sizeof(Pattern *) * n);
+    nr_sub[v] = 0;
+    for (int i = 0; i < n; i++) {
+      if (compatible(cand[i], field, val)) sub[v][nr_sub[v]++] = cand[i];
+    }
+    group[v] = v;
+    for (int u = 0; u < v; u++) {
+      if (group[u] == u && nr_sub[u] == nr_sub[v] &&
+          memcmp(sub[u], sub[v], sizeof(Pattern *) * nr_sub[v]) == 0) { group[v] = u; break; }
+    }
+    group_size[group[v]]++;
+  }
+  // the largest group becomes the default branch
+  int def = 0;
+  for (int v = 0; v < nr_val; v++) if (group_size[v] > group_size[def]) def = v;
+
+  indent(level); fputs("switch (", out); emit_field(bits, nr_bits); fputs(") {\n", out);
+  for (int v = 0; v < nr_val; v++) {
+    if (group[v] != v || v == def) continue;
+    for (int u = v; u < nr_val; u++) {
+      if (group[u] == v) { indent(level + 1); fprintf(out, "case 0x%x:\n", u); }
+    }
+    build(sub[v], nr_sub[v], known | field, width, level + 2);
+  }
+  indent(level + 1); fputs("default:\n", out);
+  build(sub[def], nr_sub[def], known | field, width, level + 2);
+  indent(level); fputs("}\n", out);
+
+  for (int v = 0; v < nr_val; v++) free(sub[v]);
+  free(sub); free(nr_sub); free(group); free(group_size);
+}
+
+static void gen_region(Region *r) {
+  Pattern *cand[MAX_PAT];
+  for (int i = 0; i < r->nr_pat; i++) cand[i] = &r->pat[i];
+  fprintf(out, "\n// %s:%d-%d\n", src_name, r->start_line, r->end_line);
+  fprintf(out, "#define __instpat_count_%d %d\n", r->end_line, r->nr_pat);
+  fprintf(out, "static inline int __instpat_decode_%d(uint64_t inst) {\n", r->start_line);
+  build(cand, r->nr_pat, 0, r->width, 1);
+  fputs("}\n", out);
+}
+
+// only touch the output if it changes, so that nothing is rebuilt needlessly
+static void write_if_changed(const char *name, const char *buf, size_t size) {
+  FILE *fp = fopen(name, "r");
+  if (fp != NULL) {
+    char *old = malloc(size + 1);
+    assert(old);
+    size_t n = fread(old, 1, size + 1, fp);
+    fclose(fp);
+    bool same = (n == size && memcmp(old, buf, size) == 0);
+    free(old);
+    if (same) return;
+  }
+  fp = fopen(name, "w");
+  if (fp == NULL) { perror(name); exit(1); }
+  fwrite(buf, 1, size, fp);
+  fclose(fp);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 3) {
+    fprintf(stderr, "usage: %s inst.c output.h\n", argv[0]);
+    return 1;
+  }
+  src_name = argv[1];
+  char *src = read_file(src_name);
+  strip_comments(src);
+  parse(src);
+
+  char *buf = NULL;
+  size_t size = 0;
+  out = open_memstream(&buf, &size);
+  assert(out);
+  fprintf(out, "// generated by tools/gen-decoder from %s, do not edit\n", src_name);
+  fputs("#ifndef __GENERATED_INSTPAT_DECODER_H__\n#define __GENERATED_INSTPAT_DECODER_H__\n", out);
+  fputs("\n#include <stdint.h>\n", out);
+  for (int i = 0; i < nr_region; i++) gen_region(&region[i]);
+  fputs("\n#endif\n", out);
+  fclose(out);
+
+  write_if_changed(argv[2], buf, size);
+  free(buf);
+  free(src);
+  return 0;
+}
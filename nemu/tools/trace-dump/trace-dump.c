@@ -0,0 +1,302 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+/* 解码 NEMU 用 --trace 生成的二进制追踪文件：
+ * 反汇编指令记录，并用 -e 给出的 ELF 文件中的符号表示函数调用和返回。
+ */
+
+#include <assert.h>
+#include <dlfcn.h>
+#include <elf.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <capstone/capstone.h>
+#include <trace-format.h>
+
+typedef struct {
+  char *name;
+  uint64_t addr;
+  uint64_t size;
+} Symbol;
+
+static Symbol *syms = NULL;
+static int nr_sym = 0;
+
+static bool show_inst = true, show_func = true;
+static int word_size = 4;
+static bool is_x86 = false;
+
+// ----------- 符号 -----------
+
+static void *read_at(FILE *fp, long off, size_t size) {
+  void *buf = malloc(size);
+  assert(buf);
+  if (fseek(fp, off, SEEK_SET) != 0 || fread(buf, size, 1, fp) != 1) {
+    free(buf);
+    return NULL;
+  }
+  return buf;
+}
+
+#define LOAD_SYMBOLS(bits) \
+static void load_symbols##bits(FILE *fp, const char *file) { \
+  Elf##bits##_Ehdr eh; \
+  if (fseek(fp, 0, SEEK_SET) != 0 || fread(&eh, sizeof(eh), 1, fp) != 1) return; \
+  Elf##bits##_Shdr *sh = read_at(fp, eh.e_shoff, sizeof(*sh) * eh.e_shnum); \
+  if (sh == NULL) return; \
+  for (int i = 0; i < eh.e_shnum; i ++) { \
+    if (sh[i].sh_type != SHT_SYMTAB) continue; \
+    Elf##bits##_Shdr *strtab = &sh[sh[i].sh_link]; \
+    Elf##bits##_Sym *s = read_at(fp, sh[i].sh_offset, sh[i].sh_size); \
+    char *str = read_at(fp, strtab->sh_offset, strtab->sh_size); \
+    int n = sh[i].sh_size / sizeof(*s); \
+    syms = realloc(syms, sizeof(Symbol) * (nr_sym + n)); \
+    for (int j = 0; s != NULL && str != NULL && j < n; j ++) { \
+      if (ELF##bits##_ST_TYPE(s[j].st_info) != STT_FUNC) continue; \
+      syms[nr_sym ++] = (Symbol) { strdup(str + s[j].st_name), s[j].st_value, s[j].st_size }; \
+    } \
+    free(s); free(str); \
+  } \
+  free(sh); \
+}
+
+LOAD_SYMBOLS(32)
+LOAD_SYMBOLS(64)
+
+static void load_elf(const char *file) {
+  FILE *fp = fopen(file, "rb");
+  if (fp == NULL) {
+    fprintf(stderr, "Cannot open ELF file '%s'\n", file);
+    exit(1);
+  }
+  unsigned char ident[EI_NIDENT];
+  if (fread(ident, sizeof(ident), 1, fp) != 1 || memcmp(ident, ELFMAG, SELFMAG) != 0) {
+    fprintf(stderr, "Invalid ELF file '%s'\n", file);
+    exit(1);
+  }
+  if (ident[EI_CLASS] == ELFCLASS64) load_symbols64(fp, file);
+  else load_symbols32(fp, file);
+  fclose(fp);
+}
+
+static int sym_cmp(const void *a, const void *b) {
+  const Symbol *x = a, *y = b;
+  return (x->addr > y->addr) - (x->addr < y->addr);
+}
+
+// 包含 addr 的起始地址最大的符号
+static Symbol* find_symbol(uint64_t addr) {
+  int lo = 0, hi = nr_sym;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (syms[mid].addr <= addr) lo = mid + 1;
+    else hi = mid;
+  }
+  for (int i = lo - 1; i >= 0 && lo - i <= 16; i --) {
+    if (addr - syms[i].addr < syms[i].size) return &syms[i];
+  }
+  return NULL;
+}
+
+// ----------- 反汇编 -----------
+
+static size_t (*cs_disasm_dl)(csh handle, const uint8_t *code,
+    size_t code_size, uint64_t address, size_t count, cs_insn **insn);
+static void (*cs_free_dl)(cs_insn *insn, size_t count);
+static csh handle;
+static bool has_disasm = false;
+
+static void init_disasm(const char *isa, const char *lib) {
+  void *dl = dlopen(lib, RTLD_LAZY);
+  if (dl == NULL) {
+    fprintf(stderr, "Cannot load %s, instructions are not disassembled\n", lib);
+    return;
+  }
+  cs_err (*cs_open_dl)(cs_arch arch, cs_mode mode, csh *handle) = dlsym(dl, "cs_open");
+  cs_err (*cs_option_dl)(csh handle, cs_opt_type type, size_t value) = dlsym(dl, "cs_option");
+  cs_disasm_dl = dlsym(dl, "cs_disasm");
+  cs_free_dl = dlsym(dl, "cs_free");
+  assert(cs_open_dl && cs_option_dl && cs_disasm_dl && cs_free_dl);
+
+  cs_arch arch;
+  cs_mode mode;
+  if (strcmp(isa, "riscv32") == 0) { arch = CS_ARCH_RISCV; mode = CS_MODE_RISCV32 | CS_MODE_RISCVC; }
+  else if (strcmp(isa, "riscv64") == 0) { arch = CS_ARCH_RISCV; mode = CS_MODE_RISCV64 | CS_MODE_RISCVC; }
+  else if (strcmp(isa, "mips32") == 0) { arch = CS_ARCH_MIPS; mode = CS_MODE_MIPS32; }
+  else if (strcmp(isa, "loongarch32r") == 0) { arch = CS_ARCH_LOONGARCH; mode = CS_MODE_LOONGARCH32; }
+  else if (strcmp(isa, "x86") == 0) { arch = CS_ARCH_X86; mode = CS_MODE_32; is_x86 = true; }
+  else {
+    fprintf(stderr, "Unknown ISA '%s', instructions are not disassembled\n", isa);
+    return;
+  }
+  if (cs_open_dl(arch, mode, &handle) != CS_ERR_OK) return;
+  if (is_x86) cs_option_dl(handle, CS_OPT_SYNTAX, CS_OPT_SYNTAX_ATT);
+  has_disasm = true;
+}
+
+// 输出格式和 NEMU 的 itrace 相同
+static void print_inst(uint64_t pc, const uint8_t *code, int ilen) {
+  char buf[128];
+  char *p = buf;
+  p += sprintf(p, "0x%0*" PRIx64 ":", word_size * 2, pc);
+  for (int i = 0; i < ilen; i ++) {
+    p += sprintf(p, " %02x", code[is_x86 ? i : ilen - 1 - i]);
+  }
+  int space_len = (is_x86 ? 8 : 4) - ilen;
+  if (space_len < 0) space_len = 0;
+  space_len = space_len * 3 + 1;
+  memset(p, ' ', space_len);
+  p += space_len;
+  *p = '\0';
+
+  cs_insn *insn;
+  if (has_disasm && cs_disasm_dl(handle, code, ilen, pc, 0, &insn) == 1) {
+    printf("%s%s%s%s\n", buf, insn->mnemonic, insn->op_str[0] ? "\t" : "", insn->op_str);
+    cs_free_dl(insn, 1);
+  } else {
+    printf("%s(unknown)\n", buf);
+  }
+}
+
+// ----------- 追踪记录 -----------
+
+static FILE *trace_fp;
+
+static uint64_t get_varint() {
+  uint64_t v = 0;
+  for (int shift = 0; ; shift += 7) {
+    int c = getc_unlocked(trace_fp);
+    if (c == EOF) {
+      fprintf(stderr, "Unexpected end of the trace\n");
+      exit(1);
+    }
+    v |= (uint64_t)(c & 0x7f) << shift;
+    if (!(c & 0x80)) return v;
+  }
+}
+
+static void print_jump(int type, uint64_t pc, uint64_t target, uint64_t depth) {
+  // 和 NEMU 的 ftrace 一样：调用显示被调用的函数，返回显示正在返回的函数
+  Symbol *s = find_symbol(type == TRACE_CALL ? target : pc);
+  printf("%s %*s0x%0*" PRIx64 ": %s", type == TRACE_CALL ? "[call]" : "[ret] ",
+      (int)depth * 2, "", word_size * 2, pc, s ? s->name : "???");
+  printf(" -> 0x%0*" PRIx64 "\n", word_size * 2, target);
+}
+
+static void dump_trace() {
+  uint64_t mask = (word_size == 8 ? UINT64_MAX : ((uint64_t)1 << (word_size * 8)) - 1);
+  uint64_t pc = 0, snpc = 0;
+  uint64_t nr_inst = 0, nr_call = 0, nr_ret = 0;
+  Symbol *last_sym = NULL;
+  uint8_t code[16];
+  int tag;
+  while ((tag = getc_unlocked(trace_fp)) != EOF) {
+    int type = TRACE_TAG_TYPE(tag);
+    switch (type) {
+      case TRACE_INST_SEQ:
+      case TRACE_INST: {
+        int ilen = TRACE_TAG_ILEN(tag);
+        pc = (type == TRACE_INST_SEQ ? snpc : pc + trace_unzigzag(get_varint())) & mask;
+        if (fread(code, ilen, 1, trace_fp) != 1) {
+          fprintf(stderr, "Unexpected end of the trace\n");
+          exit(1);
+        }
+        snpc = (pc + ilen) & mask;
+        nr_inst ++;
+        if (show_inst) {
+          Symbol *s = find_symbol(pc);
+          if (s != last_sym && s != NULL) printf("%s:\n", s->name);
+          last_sym = s;
+          print_inst(pc, code, ilen);
+        }
+        break;
+      }
+      case TRACE_CALL:
+      case TRACE_RET: {
+        uint64_t target = (pc + trace_unzigzag(get_varint())) & mask;
+        uint64_t depth = get_varint();
+        if (type == TRACE_CALL) nr_call ++; else nr_ret ++;
+        if (show_func) print_jump(type, pc, target, depth);
+        break;
+      }
+      default:
+        fprintf(stderr, "Invalid record tag 0x%02x\n", tag);
+        exit(1);
+    }
+  }
+  fprintf(stderr, "%" PRIu64 " instructions, %" PRIu64 " calls, %" PRIu64 " returns\n",
+      nr_inst, nr_call, nr_ret);
+}
+
+static void usage(const char *name) {
+  printf("Usage: %s [OPTION...] TRACE\n\n", name);
+  printf("\t-e,--elf=ELF_FILE       load symbols from ELF file, can be given more than once\n");
+  printf("\t-i,--inst               only show instructions\n");
+  printf("\t-f,--func               only show function calls and returns\n");
+  printf("\t-c,--capstone=LIB       use LIB to disassemble instructions\n");
+  printf("\n");
+  exit(0);
+}
+
+int main(int argc, char *argv[]) {
+  const struct option table[] = {
+    {"elf"      , required_argument, NULL, 'e'},
+    {"inst"     , no_argument      , NULL, 'i'},
+    {"func"     , no_argument      , NULL, 'f'},
+    {"capstone" , required_argument, NULL, 'c'},
+    {"help"     , no_argument      , NULL, 'h'},
+    {0          , 0                , NULL,  0 },
+  };
+  const char *lib = LIBCAPSTONE;
+  int o;
+  while ( (o = getopt_long(argc, argv, "e:ifc:h", table, NULL)) != -1) {
+    switch (o) {
+      case 'e': load_elf(optarg); break;
+      case 'i': show_func = false; break;
+      case 'f': show_inst = false; break;
+      case 'c': lib = optarg; break;
+      default: usage(argv[0]);
+    }
+  }
+  if (optind != argc - 1) usage(argv[0]);
+  qsort(syms, nr_sym, sizeof(Symbol), sym_cmp);
+
+  trace_fp = fopen(argv[optind], "rb");
+  if (trace_fp == NULL) {
+    fprintf(stderr, "Cannot open trace file '%s'\n", argv[optind]);
+    return 1;
+  }
+  static char iobuf[1 << 20];
+  setvbuf(trace_fp, iobuf, _IOFBF, sizeof(iobuf));
+
+  TraceHeader h;
+  if (fread(&h, sizeof(h), 1, trace_fp) != 1 || memcmp(h.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0 ||
+      h.version != TRACE_VERSION) {
+    fprintf(stderr, "'%s' is not a NEMU trace file of version %d\n", argv[optind], TRACE_VERSION);
+    return 1;
+  }
+  word_size = h.word_size;
+  h.isa[sizeof(h.isa) - 1] = '\0';
+  if (show_inst) init_disasm(h.isa, lib);
+
+  dump_trace();
+  fclose(trace_fp);
+  return 0;
+}